@@ -0,0 +1,357 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "defines.h"
+#include "generator.h"
+#include "parser.h"
+#include "timer.h"
+#include "tokenizer.h"
+#include "utils.h"
+
+/// Where the corpora are generated, `ribs bench` creates it
+#define BENCH_DIR "build/bench/"
+
+/// Phases timed on every run, each over the whole corpus.
+typedef enum {
+  bench_lex,  // Opening the source and lexing it
+  bench_parse,
+  bench_generate,  // C into memory, nothing is written
+  bench_total,
+  bench_phases_len,
+} bench_phase;
+
+/// @internal
+INTERNAL_DEF const char *bench_phase_names[bench_phases_len] = {
+    [bench_lex] = "lex",
+    [bench_parse] = "parse",
+    [bench_generate] = "generate",
+    [bench_total] = "total",
+};
+
+/// @internal
+/// Statement `t_i` of a corpus, appended to `t_out`. Returns the bytes
+/// written.
+typedef int (*bench_write_stmt)(FILE *t_out, size_t t_i);
+
+/// @internal
+/// Short declarations and exits, the common case.
+INTERNAL_DEF int bench_write_stmts(FILE *t_out, size_t t_i) {
+  if (t_i % 4 == 3) return fprintf(t_out, "exit(x%zu)\n", t_i - 1);
+  return fprintf(t_out, "x%zu := %zu + %zu * %zu\n", t_i, t_i % 97,
+                 t_i % 13 + 1, t_i % 1000);
+}
+
+/// @internal
+/// Long names, every one of them new, which stresses interning.
+INTERNAL_DEF int bench_write_idents(FILE *t_out, size_t t_i) {
+  if (t_i == 0) {
+    return fprintf(t_out, "someRatherLongDescriptiveIdentifierName0 := 1\n");
+  }
+  return fprintf(t_out,
+                 "someRatherLongDescriptiveIdentifierName%zu := "
+                 "someRatherLongDescriptiveIdentifierName%zu * 3 + "
+                 "anotherLongIdentifierForTheOperand%zu\n",
+                 t_i, t_i - 1, t_i % 512);
+}
+
+/// Operators in a deep expression, so every binding power is exercised
+#define BENCH_DEEP_TERMS 1024
+
+/// @internal
+/// One long expression per statement. Chains like these group to the left,
+/// so the parser and generator work through deep trees.
+INTERNAL_DEF int bench_write_deep(FILE *t_out, size_t t_i) {
+  static const char ops[] = {'+', '-', '*', '/'};
+  int written = fprintf(t_out, "d%zu := 1", t_i);
+  for (size_t i = 0; i < BENCH_DEEP_TERMS; ++i) {
+    written += fprintf(t_out, " %c %zu", ops[(t_i + i) % 4], i % 9 + 1);
+  }
+  written += fprintf(t_out, "\n");
+  return written;
+}
+
+/// @internal
+/// Four lines of comments per statement.
+INTERNAL_DEF int bench_write_comments(FILE *t_out, size_t t_i) {
+  int written = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    written += fprintf(t_out,
+                       "// comment %zu of statement %zu explains what the "
+                       "code below does\n",
+                       i, t_i);
+  }
+  written += fprintf(t_out, "c%zu := %zu\n", t_i, t_i % 1000);
+  return written;
+}
+
+typedef struct {
+  const char *name;
+  bench_write_stmt write_stmt;
+} bench_corpus;
+
+/// @internal
+INTERNAL_DEF const bench_corpus bench_corpora[] = {
+    {"stmts", bench_write_stmts},
+    {"idents", bench_write_idents},
+    {"deep", bench_write_deep},
+    {"comments", bench_write_comments},
+};
+#define BENCH_CORPORA_LEN (sizeof(bench_corpora) / sizeof(bench_corpus))
+
+/// @internal
+/// Writes statements of `t_corpus` to `t_file` until it is `t_size` bytes.
+/// The same size always gives the same file, so runs on different commits
+/// compare.
+INTERNAL_DEF bool bench_write_corpus(const bench_corpus *t_corpus,
+                                     const char *t_file, size_t t_size) {
+  FILE *out = fopen(t_file, "wb");
+  if (!out) {
+    fprintf(stderr, "Error: could not open file `%s`: %s\n", t_file,
+            strerror(errno));
+    return false;
+  }
+  size_t size = 0;
+  for (size_t i = 0; size < t_size; ++i) {
+    int written = t_corpus->write_stmt(out, i);
+    if (written < 0) break;
+    size += (size_t)written;
+  }
+  bool success = !ferror(out);
+  success = !fclose(out) && success;
+  if (!success) {
+    fprintf(stderr, "Error: could not write file `%s`: %s\n", t_file,
+            strerror(errno));
+  }
+  return success;
+}
+
+/// @internal
+INTERNAL_DEF int bench_compare_ns(const void *t_lhs, const void *t_rhs) {
+  uint64_t lhs = *(const uint64_t *)t_lhs;
+  uint64_t rhs = *(const uint64_t *)t_rhs;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+/// Time of a phase on the median run and on the 99th percentile run, the
+/// slowest but one in a hundred.
+typedef struct {
+  uint64_t median_ns;
+  uint64_t p99_ns;
+} bench_stats;
+
+/// @internal
+/// Sorts `t_ns` in place.
+INTERNAL_DEF bench_stats bench_stats_of(uint64_t *t_ns, size_t t_runs) {
+  qsort(t_ns, t_runs, sizeof(uint64_t), bench_compare_ns);
+  size_t p99 = (t_runs * 99 + 99) / 100;
+  return (bench_stats){.median_ns = t_ns[t_runs / 2],
+                       .p99_ns = t_ns[p99 > 0 ? p99 - 1 : 0]};
+}
+
+/// @internal
+/// Items per second, `t_per` scales them, like to MB.
+INTERNAL_DEF double bench_rate(size_t t_items, uint64_t t_ns, double t_per) {
+  if (t_ns == 0) return 0;
+  return (double)t_items * 1e9 / (double)t_ns / t_per;
+}
+
+typedef struct {
+  size_t bytes;
+  size_t tokens;
+  bench_stats phases[bench_phases_len];
+} bench_result;
+
+/// @internal
+/// Compiles `t_file` to C in memory `t_runs` times, after a run that warms the
+/// page cache and the arena up. Returns false if it does not parse.
+INTERNAL_DEF bool bench_run(const char *t_file, size_t t_runs,
+                            bench_result *t_result) {
+  arena_allocator_t arena = {};
+  rda_allocator allocator = {arena_allocator_alloc, arena_allocator_free,
+                             arena_allocator_realloc, &arena};
+  uint64_t *ns[bench_phases_len];
+  for (size_t i = 0; i < bench_phases_len; ++i) {
+    ns[i] = malloc(t_runs * sizeof(uint64_t));
+  }
+  bool success = true;
+  for (size_t run = 0; run <= t_runs && success; ++run) {
+    timer_passes_t timers = {};
+    parser_t parser;
+    if (!parser_init_with_allocator(&parser, t_file, 0, &timers,
+                                    &allocator)) {
+      success = false;
+      break;
+    }
+    uint64_t lex_ns = timers.ns[timer_read] + timers.ns[timer_lex];
+    uint64_t parse_ns = timers.ns[timer_parse];
+    uint64_t start = timer_now();
+    success = parse(&parser);
+    parse_ns += timer_now() - start;
+    uint64_t generate_ns = 0;
+    if (success) {
+      start = timer_now();
+      generator_t gen;
+      generator_init(&gen, rsv_size(parser.tokenizer->buffer) + 64,
+                     &parser.tokenizer->symbols, &allocator);
+      generate_stmts(&gen, &parser.prg);
+      generator_close(&gen);
+      generate_ns = timer_now() - start;
+    }
+    t_result->bytes = rsv_size(parser.tokenizer->buffer);
+    t_result->tokens = tokens_size(&parser.tokenizer->tokens);
+    parser_deinit(&parser);
+    arena_allocator_reset(&arena);
+    if (run == 0) continue;
+    ns[bench_lex][run - 1] = lex_ns;
+    ns[bench_parse][run - 1] = parse_ns;
+    ns[bench_generate][run - 1] = generate_ns;
+    ns[bench_total][run - 1] = lex_ns + parse_ns + generate_ns;
+  }
+  if (!success) fprintf(stderr, "Error: `%s` failed to compile\n", t_file);
+
+  for (size_t i = 0; i < bench_phases_len; ++i) {
+    if (success) t_result->phases[i] = bench_stats_of(ns[i], t_runs);
+    free(ns[i]);
+  }
+  arena_allocator_free(&arena, nullptr);
+  return success;
+}
+
+/// @internal
+INTERNAL_DEF void bench_print(const char *t_name,
+                              const bench_result *t_result) {
+  printf("%-10s %9.2f MB %12zu tokens\n", t_name,
+         (double)t_result->bytes / 1e6, t_result->tokens);
+  for (size_t i = 0; i < bench_phases_len; ++i) {
+    const bench_stats *stats = &t_result->phases[i];
+    printf("  %-10s median %9.2f MB/s %12.0f tokens/s   p99 %9.2f MB/s "
+           "%12.0f tokens/s\n",
+           bench_phase_names[i],
+           bench_rate(t_result->bytes, stats->median_ns, 1e6),
+           bench_rate(t_result->tokens, stats->median_ns, 1),
+           bench_rate(t_result->bytes, stats->p99_ns, 1e6),
+           bench_rate(t_result->tokens, stats->p99_ns, 1));
+  }
+}
+
+/// @internal
+INTERNAL_DEF void bench_write_json(FILE *t_out, const char *t_name,
+                                   const bench_result *t_result) {
+  fprintf(t_out,
+          "    {\"name\": \"%s\", \"bytes\": %zu, \"tokens\": %zu, "
+          "\"phases\": [\n",
+          t_name, t_result->bytes, t_result->tokens);
+  for (size_t i = 0; i < bench_phases_len; ++i) {
+    const bench_stats *stats = &t_result->phases[i];
+    fprintf(t_out,
+            "      {\"phase\": \"%s\", \"median_ns\": %llu, \"p99_ns\": %llu, "
+            "\"median_mb_s\": %.3f, \"p99_mb_s\": %.3f, "
+            "\"median_tokens_s\": %.0f, \"p99_tokens_s\": %.0f}%s\n",
+            bench_phase_names[i], (unsigned long long)stats->median_ns,
+            (unsigned long long)stats->p99_ns,
+            bench_rate(t_result->bytes, stats->median_ns, 1e6),
+            bench_rate(t_result->bytes, stats->p99_ns, 1e6),
+            bench_rate(t_result->tokens, stats->median_ns, 1),
+            bench_rate(t_result->tokens, stats->p99_ns, 1),
+            i + 1 < bench_phases_len ? "," : "");
+  }
+  fprintf(t_out, "    ]}");
+}
+
+void help_msg(const char *utils_prg_name) {
+  printf("Usage: %s [--size=MB] [--runs=N] [--label=text] [-o out] "
+         "[corpora...]\n",
+         utils_prg_name);
+  printf("Generates synthetic .th files into %s and times lexing, parsing "
+         "and generating C\nfor each of them in memory, reporting the median "
+         "and 99th percentile run\n",
+         BENCH_DIR);
+  printf("args:\n");
+  printf("    corpora   Which corpora to run, all of them by default: "
+         "stmts, idents, deep,\n"
+         "              comments\n");
+  printf("    --size    Size of each corpus in MB, defaults to 8\n");
+  printf("    --runs    Timed runs of each corpus, defaults to 20\n");
+  printf("    --label   Recorded in the results, like the commit that was "
+         "measured\n");
+  printf("    -o        Where to write the results as JSON, defaults to "
+         "build/bench.json\n");
+}
+
+int main(int argc, char **argv) {
+  char *prg = utils_shift_args(&argc, &argv);
+  size_t size = 8;
+  size_t runs = 20;
+  const char *label = "";
+  const char *out_file = "build/bench.json";
+  bool selected[BENCH_CORPORA_LEN] = {};
+  bool any_selected = false;
+  while (argc > 0) {
+    char *arg = utils_shift_args(&argc, &argv);
+    if (!strncmp(arg, "--size=", strlen("--size="))) {
+      size = strtoul(arg + strlen("--size="), nullptr, 10);
+    } else if (!strncmp(arg, "--runs=", strlen("--runs="))) {
+      runs = strtoul(arg + strlen("--runs="), nullptr, 10);
+    } else if (!strncmp(arg, "--label=", strlen("--label="))) {
+      label = arg + strlen("--label=");
+    } else if (!strcmp(arg, "-o")) {
+      out_file = utils_shift_args(&argc, &argv);
+    } else if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+      help_msg(prg);
+      return 0;
+    } else {
+      size_t i = 0;
+      while (i < BENCH_CORPORA_LEN && strcmp(arg, bench_corpora[i].name)) ++i;
+      if (i == BENCH_CORPORA_LEN) {
+        help_msg(prg);
+        fprintf(stderr, "Error: unknown corpus %s\n", arg);
+        return 1;
+      }
+      selected[i] = true;
+      any_selected = true;
+    }
+  }
+  if (size == 0 || runs == 0) {
+    fprintf(stderr, "Error: --size and --runs must be at least 1\n");
+    return 1;
+  }
+
+  FILE *out = fopen(out_file, "wb");
+  if (!out) {
+    fprintf(stderr, "Error: could not open file `%s`: %s\n", out_file,
+            strerror(errno));
+    return 1;
+  }
+  fprintf(out,
+          "{\"label\": \"%s\", \"size_mb\": %zu, \"runs\": %zu, "
+          "\"corpora\": [\n",
+          label, size, runs);
+  bool first = true;
+  for (size_t i = 0; i < BENCH_CORPORA_LEN; ++i) {
+    if (any_selected && !selected[i]) continue;
+    const bench_corpus *corpus = &bench_corpora[i];
+    char file[256];
+    snprintf(file, sizeof(file), BENCH_DIR "%s.th", corpus->name);
+    bench_result result = {};
+    if (!bench_write_corpus(corpus, file, size * 1000 * 1000) ||
+        !bench_run(file, runs, &result)) {
+      fclose(out);
+      return 1;
+    }
+    bench_print(corpus->name, &result);
+    if (!first) fprintf(out, ",\n");
+    bench_write_json(out, corpus->name, &result);
+    first = false;
+  }
+  fprintf(out, "\n]}\n");
+  if (fclose(out)) {
+    fprintf(stderr, "Error: could not write file `%s`: %s\n", out_file,
+            strerror(errno));
+    return 1;
+  }
+  printf("[INFO] Results written to %s\n", out_file);
+}
@@ -0,0 +1,138 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "defines.h"
+#include "timer.h"
+#include "tokenizer.h"
+#include "utils.h"
+
+/// Where the source is generated, `ribs bench --lex` creates it
+#define BENCH_LEX_FILE "build/bench/lex.th"
+/// Distinct names in the source, each is copied once into the symbol table
+/// however many times it appears
+#define BENCH_LEX_NAMES 4096
+
+/// @internal
+/// Writes `t_lines` statements of identifiers and numbers to `t_file`, the
+/// tokens that used to be copied into a string of their own each.
+INTERNAL_DEF bool bench_lex_write(const char *t_file, size_t t_lines) {
+  FILE *out = fopen(t_file, "wb");
+  if (!out) {
+    fprintf(stderr, "Error: could not open file `%s`: %s\n", t_file,
+            strerror(errno));
+    return false;
+  }
+  for (size_t i = 0; i < t_lines; ++i) {
+    if (i % 4 == 3) {
+      fprintf(out, "exit(value%zu)\n", (i - 1) % BENCH_LEX_NAMES);
+    } else {
+      fprintf(out, "value%zu := %zu + counter%zu * %zu\n", i % BENCH_LEX_NAMES,
+              i % 97, i % 64, i % 1000 + 1);
+    }
+  }
+  bool success = !ferror(out);
+  success = !fclose(out) && success;
+  if (!success) {
+    fprintf(stderr, "Error: could not write file `%s`: %s\n", t_file,
+            strerror(errno));
+  }
+  return success;
+}
+
+void help_msg(const char *utils_prg_name) {
+  printf("Usage: %s [--lines=N] [--runs=N]\n", utils_prg_name);
+  printf("Generates a .th file of identifiers and numbers into %s, lexes it "
+         "and reports\nhow many allocations lexing made, and the median time "
+         "it took. Tokens are\nsliced out of the source, only the first "
+         "occurrence of a name is copied, into\nthe symbol table\n",
+         BENCH_LEX_FILE);
+  printf("args:\n");
+  printf("    --lines   Statements in the file, defaults to 100000\n");
+  printf("    --runs    Timed runs, defaults to 20\n");
+}
+
+/// @internal
+INTERNAL_DEF int bench_lex_compare_ns(const void *t_lhs, const void *t_rhs) {
+  uint64_t lhs = *(const uint64_t *)t_lhs;
+  uint64_t rhs = *(const uint64_t *)t_rhs;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+int main(int argc, char **argv) {
+  char *prg = utils_shift_args(&argc, &argv);
+  size_t lines = 100000;
+  size_t runs = 20;
+  while (argc > 0) {
+    char *arg = utils_shift_args(&argc, &argv);
+    if (!strncmp(arg, "--lines=", strlen("--lines="))) {
+      lines = strtoul(arg + strlen("--lines="), nullptr, 10);
+    } else if (!strncmp(arg, "--runs=", strlen("--runs="))) {
+      runs = strtoul(arg + strlen("--runs="), nullptr, 10);
+    } else if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+      help_msg(prg);
+      return 0;
+    } else {
+      help_msg(prg);
+      fprintf(stderr, "Error: unknown argument %s\n", arg);
+      return 1;
+    }
+  }
+  if (lines == 0 || runs == 0) {
+    fprintf(stderr, "Error: --lines and --runs must be at least 1\n");
+    return 1;
+  }
+  if (!bench_lex_write(BENCH_LEX_FILE, lines)) return 1;
+
+  arena_allocator_t arena = {};
+  rda_allocator inner = {arena_allocator_alloc, arena_allocator_free,
+                         arena_allocator_realloc, &arena};
+  allocator_counter_t counter = {.inner = &inner};
+  rda_allocator allocator = allocator_counter_wrap(&counter);
+  uint64_t *ns = malloc(runs * sizeof(uint64_t));
+  size_t bytes = 0;
+  size_t tokens = 0;
+  size_t names = 0;
+  allocator_counter_t lexed = {};
+  // The first run warms the page cache and the arena up, it is not timed
+  for (size_t run = 0; run <= runs; ++run) {
+    tokenizer_t tokenizer;
+    if (!tokenizer_init(&tokenizer, BENCH_LEX_FILE, &allocator)) {
+      free(ns);
+      arena_allocator_free(&arena, nullptr);
+      return 1;
+    }
+    allocator_counter_t before = counter;
+    uint64_t start = timer_now();
+    tokenize(&tokenizer);
+    uint64_t elapsed = timer_now() - start;
+    // Only what lexing itself allocated, not opening the file
+    lexed = (allocator_counter_t){
+        .allocs = counter.allocs - before.allocs,
+        .requested = counter.requested - before.requested,
+        .moved = counter.moved - before.moved};
+    bytes = rsv_size(tokenizer.buffer);
+    tokens = tokens_size(&tokenizer.tokens);
+    names = symbols_size(&tokenizer.symbols);
+    tokenizer_deinit(&tokenizer);
+    arena_allocator_reset(&arena);
+    if (run > 0) ns[run - 1] = elapsed;
+  }
+  qsort(ns, runs, sizeof(uint64_t), bench_lex_compare_ns);
+  uint64_t median_ns = ns[runs / 2];
+  free(ns);
+  arena_allocator_free(&arena, nullptr);
+
+  printf("%zu lines, %.2f MB, %zu tokens, %zu distinct names\n", lines,
+         (double)bytes / 1e6, tokens, names);
+  printf("  allocations  %zu, %.4f per token\n", lexed.allocs,
+         tokens ? (double)lexed.allocs / (double)tokens : 0);
+  printf("  requested    %zu bytes, %.2f per token\n", lexed.requested,
+         tokens ? (double)lexed.requested / (double)tokens : 0);
+  printf("  moved        %zu bytes\n", lexed.moved);
+  printf("  median       %.3f ms, %.2f MB/s\n", (double)median_ns / 1e6,
+         median_ns ? (double)bytes * 1e3 / (double)median_ns : 0);
+}
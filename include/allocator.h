@@ -3,10 +3,65 @@
 
 #include <stddef.h>
 
+#include "libraries/rit_dyn_arr.h"
+
+/// @internal
+/// A block of memory allocations are bumped out of. `data` is aligned for any
+/// type.
+typedef struct arena_block arena_block;
+struct arena_block {
+  arena_block *prev;  // The block used before this one
+  size_t size;        // Bytes in `data`
+  size_t used;        // Bytes of `data` handed out
+  max_align_t data[];
+};
+
+/// Bump allocator behind every `rda_allocator` in the compiler, passed as its
+/// `m_ctx`. Memory is only given back all at once, but the most recent
+/// allocation grows in place when there is room after it, so a dynamic array
+/// doubling at the top of the arena does not leave its old copy behind. The
+/// counters below tell how much memory the arena holds and how much of it is
+/// dead. A zeroed `arena_allocator_t` is an empty arena.
+typedef struct {
+  arena_block *head;  // Block being allocated from
+  void *top;          // Most recent allocation in `head`, `nullptr` if none
+  size_t reserved;    // Bytes in all blocks
+  size_t used;        // Bytes handed out, including wasted ones
+  size_t wasted;      // Bytes left behind by allocations that had to move to
+                      // grow, and by block tails too small to allocate from
+  size_t peak;        // Highest `reserved` since the arena was created
+  size_t blocks;      // Blocks allocated since the arena was created
+} arena_allocator_t;
+
+/// Allocations are rounded up to this, enough for any type the compiler uses
+#define ARENA_ALLOCATOR_ALIGN 16
+/// Size of a new block, unless the allocation needing it is bigger
+#define ARENA_ALLOCATOR_BLOCK_SIZE (64 * 1024)
+
 void *arena_allocator_alloc(void *t_arena, size_t t_size_in_bytes);
+/// With `t_ptr` set, gives the memory back only if it is the most recent
+/// allocation. With `t_ptr` `nullptr`, frees every block and empties the
+/// arena, which can be used again right away.
 void arena_allocator_free(void *t_arena, void *t_ptr);
 void *arena_allocator_realloc(void *t_arena, void *t_old_ptr,
                               size_t t_old_size_in_bytes,
                               size_t t_new_size_in_bytes);
+/// Empties the arena but keeps its most recent block, so a caller that
+/// compiles one file after another does not go back to `malloc()` each time.
+void arena_allocator_reset(void *t_arena);
+/// Prints the arena's counters to stderr.
+void arena_allocator_print(const arena_allocator_t *t_arena);
+
+/// Passes every call on to `inner` and counts it, for `--mem-stats`. It is
+/// used through the `rda_allocator` that `allocator_counter_wrap()` returns.
+typedef struct {
+  rda_allocator *inner;
+  size_t allocs;     // Calls to `alloc()` and `realloc()`
+  size_t requested;  // Bytes asked for, only the growth for `realloc()`
+  size_t moved;      // Bytes `realloc()` left behind by moving, read from the
+                     // arena's `wasted` when `inner` is one
+} allocator_counter_t;
+
+rda_allocator allocator_counter_wrap(allocator_counter_t *t_counter);
 
 #endif  // ALLOCATOR_H_INCLUDED
@@ -0,0 +1,51 @@
+#ifndef CACHE_H_INCLUDED
+#define CACHE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defines.h"
+#include "libraries/rit_dyn_arr.h"
+#include "libraries/rit_str.h"
+#include "optimizer.h"
+
+/// Generated code kept on disk, keyed by what it was generated from: the
+/// source bytes, `THOR_VERSION`, a hash of the compiler's executable and the
+/// options that change the output. A file compiled again unchanged is copied
+/// out of the cache without being lexed. Each entry is a file of its own
+/// named after its key, so several compilers can share a cache, the last one
+/// to store a key wins.
+typedef struct {
+  char dir[512];    // Ends with a separator
+  size_t max_size;  // Bytes `cache_evict()` trims the entries down to
+  uint64_t build;   // Hash of the running executable, read once
+} cache_t;
+
+#define CACHE_DEFAULT_SIZE_MB 256
+/// Read when `--cache-dir` is not given, so CI can turn the cache on for
+/// every compilation
+#define CACHE_DIR_ENV "THOR_CACHE_DIR"
+
+/// Sets up `t_cache` in `t_dir`, creating the directory if it does not exist.
+/// The compiler's executable is hashed once here.
+bool cache_init(cache_t *t_cache, const char *t_dir, size_t t_max_size);
+/// Key of the code generated from `t_src` at `t_level` into a `t_ext` file,
+/// the extension standing for the backend.
+uint64_t cache_key(const cache_t *t_cache, rsv t_src, opt_level t_level,
+                   const char *t_ext);
+/// Copies the entry of `t_key` to `t_out_file` (`-` for stdout) and marks it
+/// as used. Returns false if there is none or it could not be copied.
+bool cache_fetch(const cache_t *t_cache, uint64_t t_key, const char *t_ext,
+                 const char *t_out_file);
+/// Copies `t_out_file` into the cache as the entry of `t_key`. The entry only
+/// appears once it is complete, so a concurrent `cache_fetch()` never sees
+/// half of it. Failing to store is not an error, it is only reported.
+void cache_store(const cache_t *t_cache, uint64_t t_key, const char *t_ext,
+                 const char *t_out_file);
+/// Removes the least recently used entries until they add up to no more than
+/// `max_size`. It lists the whole directory, so call it once per run rather
+/// than after every store. The listing is allocated with `t_allocator`.
+void cache_evict(const cache_t *t_cache, rda_allocator *t_allocator);
+
+#endif  // CACHE_H_INCLUDED
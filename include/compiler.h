@@ -0,0 +1,55 @@
+#ifndef COMPILER_H_INCLUDED
+#define COMPILER_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cache.h"
+#include "defines.h"
+#include "libraries/rit_dyn_arr.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "symbols.h"
+#include "timer.h"
+
+/// Writes the code for a program to a file, `generate()` and
+/// `generate_x86_64()` are the backends.
+typedef bool (*compiler_backend)(const char *t_file_name, node_prg *t_prg,
+                                 symbols_t *t_symbols,
+                                 rda_allocator *t_allocator);
+
+typedef rda_struct(char *) compiler_files_t;
+
+typedef struct {
+  opt_level level;
+  compiler_backend backend;
+  const char *out_ext;  // Replaces `.th` in the output of each file
+  size_t lex_jobs;      // Threads lexing each file, 0 or 1 lexes serially
+  timer_passes_t *timers;  // Where to add up the time of each phase, or
+                           // `nullptr` not to time them
+  const cache_t *cache;    // Where to look for and keep generated code, or
+                           // `nullptr` to always compile. Not consulted when
+                           // timing, so that every phase runs
+} compiler_options;
+
+/// Compiles `t_file` into `t_out_file` (`nullptr` for the backend's default),
+/// using `t_allocator` for everything. The caller owns the allocator and can
+/// reset it once this returns. With a cache, a file compiled before with the
+/// same options is only hashed and its output copied from the cache.
+bool compile_file(const char *t_file, const char *t_out_file,
+                  const compiler_options *t_options,
+                  rda_allocator *t_allocator);
+
+/// Compiles every file on a pool of `t_jobs` threads (0 for one per core),
+/// each writing its output next to its input. Each worker has an arena of its
+/// own that is reset between files, so workers never share memory.
+bool compile_files(char **t_files, size_t t_files_len,
+                   const compiler_options *t_options, size_t t_jobs);
+
+bool compiler_is_dir(const char *t_path);
+
+/// Appends the `.th` files in `t_dir` to `t_files`, in no particular order.
+bool compiler_list_dir(const char *t_dir, compiler_files_t *t_files,
+                       rda_allocator *t_allocator);
+
+#endif  // COMPILER_H_INCLUDED
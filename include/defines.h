@@ -5,6 +5,10 @@
 
 #define BIN_NAME_MAX_SZ 16
 
+/// Version of the compiler, part of every cache key along with a hash of the
+/// executable
+#define THOR_VERSION "0.1.0"
+
 #define nullptr (void *)0
 
 #define INTERNAL_DEF static
@@ -0,0 +1,151 @@
+#ifndef EMITTER_H_INCLUDED
+#define EMITTER_H_INCLUDED
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "defines.h"
+#include "libraries/rit_str.h"
+
+/// Accumulates generated code in a growable buffer owned by `allocator`, so
+/// code generation does no stdio formatting or locking per node. The whole
+/// buffer is written out with a single `write()` at the end, or in pieces
+/// with `emitter_flush()` when the output must not be held in memory.
+typedef struct {
+  struct rstr buffer;
+  rstr_allocator *allocator;
+} emitter_t;
+
+/// `t_size_hint` is the expected output size, reserving it up front avoids
+/// copying the buffer as it grows.
+static inline void emitter_init(emitter_t *t_emitter, size_t t_size_hint,
+                                rstr_allocator *t_allocator) {
+  *t_emitter = (emitter_t){.buffer = {}, .allocator = t_allocator};
+  // Whatever size is specified, double the size is actually allocated
+  rstr_init(t_emitter->buffer, t_size_hint / 2, t_allocator);
+  t_emitter->buffer.m_size = 0;
+}
+
+static inline void emit_str(emitter_t *t_emitter, rsv t_str) {
+  rstr_append_str(t_emitter->buffer, t_str, t_emitter->allocator);
+}
+
+static inline void emit_cstr(emitter_t *t_emitter, const char *t_str) {
+  emit_str(t_emitter, rsv_lit(t_str));
+}
+
+static inline void emit_char(emitter_t *t_emitter, char t_c) {
+  rstr_push_back(t_emitter->buffer, t_c, t_emitter->allocator);
+}
+
+static inline void emit_int64(emitter_t *t_emitter, int64_t t_value) {
+  // Enough for "-9223372036854775808"
+  char digits[20];
+  size_t len = 0;
+  // Negate as unsigned so INT64_MIN does not overflow
+  uint64_t value = t_value < 0 ? 0 - (uint64_t)t_value : (uint64_t)t_value;
+  do {
+    digits[sizeof(digits) - 1 - len++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value);
+  if (t_value < 0) emit_char(t_emitter, '-');
+  emit_str(t_emitter, (rsv){.m_str = digits + sizeof(digits) - len,
+                            .m_size = len});
+}
+
+#if defined(BUILD_WINDOWS)
+static inline bool emitter_flush_file(emitter_t *t_emitter, FILE *t_file) {
+  size_t size = rstr_size(t_emitter->buffer);
+  if (fwrite(rstr_cstr(t_emitter->buffer), 1, size, t_file) != size) {
+    fprintf(stderr, "Error: could not write generated code\n");
+    return false;
+  }
+  t_emitter->buffer.m_size = 0;
+  return true;
+}
+#else
+/// Writes the buffer to `t_fd`, which may be a file or a pipe, and empties
+/// it.
+static inline bool emitter_flush_fd(emitter_t *t_emitter, int t_fd) {
+  const char *data = rstr_cstr(t_emitter->buffer);
+  size_t size = rstr_size(t_emitter->buffer);
+  while (size > 0) {
+    ssize_t written = write(t_fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "Error: could not write generated code: %s\n",
+              strerror(errno));
+      return false;
+    }
+    data += written;
+    size -= (size_t)written;
+  }
+  t_emitter->buffer.m_size = 0;
+  return true;
+}
+#endif  // BUILD_WINDOWS
+
+#if defined(BUILD_WINDOWS)
+typedef FILE *emitter_file_t;
+#else
+typedef int emitter_file_t;
+#endif  // BUILD_WINDOWS
+
+/// Opens `t_file_name` for writing, or stdout if it is `-`.
+static inline bool emitter_open(const char *t_file_name,
+                                emitter_file_t *t_file) {
+  bool to_stdout = !strcmp(t_file_name, "-");
+#if defined(BUILD_WINDOWS)
+  *t_file = to_stdout ? stdout : fopen(t_file_name, "wb");
+  bool success = *t_file != nullptr;
+#else
+  *t_file = to_stdout ? STDOUT_FILENO
+                      : open(t_file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool success = *t_file >= 0;
+#endif  // BUILD_WINDOWS
+  if (!success) {
+    fprintf(stderr, "Error: could not open file `%s`: %s\n", t_file_name,
+            strerror(errno));
+  }
+  return success;
+}
+
+/// Writes the buffer out and empties it, so the output can be produced
+/// piece by piece.
+static inline bool emitter_flush(emitter_t *t_emitter, emitter_file_t t_file) {
+#if defined(BUILD_WINDOWS)
+  return emitter_flush_file(t_emitter, t_file);
+#else
+  return emitter_flush_fd(t_emitter, t_file);
+#endif  // BUILD_WINDOWS
+}
+
+/// Closes a file from `emitter_open()`, leaving stdout open.
+static inline bool emitter_close(const char *t_file_name,
+                                 emitter_file_t t_file) {
+  if (!strcmp(t_file_name, "-")) return true;
+#if defined(BUILD_WINDOWS)
+  bool success = fclose(t_file) == 0;
+#else
+  bool success = close(t_file) == 0;
+#endif  // BUILD_WINDOWS
+  if (!success) {
+    fprintf(stderr, "Error: could not write file `%s`: %s\n", t_file_name,
+            strerror(errno));
+  }
+  return success;
+}
+
+/// Writes the buffer to `t_file_name`, or to stdout if it is `-`.
+static inline bool emitter_write_file(emitter_t *t_emitter,
+                                      const char *t_file_name) {
+  emitter_file_t file;
+  if (!emitter_open(t_file_name, &file)) return false;
+  bool success = emitter_flush(t_emitter, file);
+  return emitter_close(t_file_name, file) && success;
+}
+
+#endif  // EMITTER_H_INCLUDED
@@ -0,0 +1,216 @@
+#ifndef FILES_H_INCLUDED
+#define FILES_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defines.h"
+#include "libraries/rit_dyn_arr.h"
+#include "thread.h"
+
+#if defined(BUILD_WINDOWS)
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <utime.h>
+#endif  // BUILD_WINDOWS
+
+/// File helpers shared by `ribs` and the compiler: hashing contents,
+/// replacing a file without it being seen half written, and keeping a
+/// directory of cached files under a size by evicting the least recently
+/// used ones.
+
+#define HASH_FNV_OFFSET 14695981039346656037ull
+
+/// Folds `t_len` bytes into the FNV-1a hash `t_hash`, start from
+/// `HASH_FNV_OFFSET`.
+static inline uint64_t hash_bytes(uint64_t t_hash, const void *t_bytes,
+                                  size_t t_len) {
+  const unsigned char *bytes = t_bytes;
+  for (size_t i = 0; i < t_len; ++i) {
+    t_hash = (t_hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return t_hash;
+}
+
+/// Folds the contents of `t_path` into `t_hash`. Returns false if it cannot
+/// be read.
+static inline bool hash_file(uint64_t *t_hash, const char *t_path) {
+  FILE *file = fopen(t_path, "rb");
+  if (!file) return false;
+  char buf[64 * 1024];
+  size_t read;
+  while ((read = fread(buf, 1, sizeof(buf), file)) > 0) {
+    *t_hash = hash_bytes(*t_hash, buf, read);
+  }
+  bool success = !ferror(file);
+  fclose(file);
+  return success;
+}
+
+/// Sets `t_mtime` to when `t_path` was last modified, in nanoseconds where
+/// the file system keeps them. Returns false if it does not exist.
+static inline bool file_mtime(const char *t_path, int64_t *t_mtime) {
+#if defined(BUILD_WINDOWS)
+  struct _stat64 st;
+  if (_stat64(t_path, &st) < 0) return false;
+  *t_mtime = (int64_t)st.st_mtime * 1000000000;
+#else
+  struct stat st;
+  if (stat(t_path, &st) < 0) return false;
+  *t_mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif  // BUILD_WINDOWS
+  return true;
+}
+
+/// Sets when `t_path` was last modified to now.
+static inline bool file_touch(const char *t_path) {
+#if defined(BUILD_WINDOWS)
+  return !_utime(t_path, NULL);
+#else
+  return !utime(t_path, NULL);
+#endif  // BUILD_WINDOWS
+}
+
+/// Copies what is left of `t_in` to `t_out`. Returns false if reading or
+/// writing fails.
+static inline bool file_copy_stream(FILE *t_in, FILE *t_out) {
+  char buf[64 * 1024];
+  size_t read;
+  bool success = true;
+  while (success && (read = fread(buf, 1, sizeof(buf), t_in)) > 0) {
+    success = fwrite(buf, 1, read, t_out) == read;
+  }
+  return !ferror(t_in) && success;
+}
+
+/// Copies `t_src` to `t_dst` through a temporary file renamed over it, so
+/// `t_dst` is never seen half written. The temporary file is named after the
+/// process and a counter, so threads and processes copying to the same
+/// `t_dst` at once do not write into each other's, the last rename wins.
+static inline bool file_copy(const char *t_src, const char *t_dst) {
+  static size_t copies = 0;
+  char tmp[1024];
+#if defined(BUILD_WINDOWS)
+  unsigned long pid = GetCurrentProcessId();
+#else
+  unsigned long pid = (unsigned long)getpid();
+#endif  // BUILD_WINDOWS
+  int len = snprintf(tmp, sizeof(tmp), "%s.%lu.%zu.tmp", t_dst, pid,
+                     thread_atomic_fetch_add(&copies, 1));
+  if (len < 0 || (size_t)len >= sizeof(tmp)) return false;
+  FILE *in = fopen(t_src, "rb");
+  if (!in) return false;
+  FILE *out = fopen(tmp, "wb");
+  if (!out) {
+    fclose(in);
+    return false;
+  }
+  bool success = file_copy_stream(in, out);
+  fclose(in);
+  success = !fclose(out) && success;
+#if defined(BUILD_WINDOWS)
+  // `rename()` does not replace an existing file on Windows
+  success = success && MoveFileExA(tmp, t_dst, MOVEFILE_REPLACE_EXISTING);
+#else
+  success = success && !rename(tmp, t_dst);
+#endif  // BUILD_WINDOWS
+  if (!success) remove(tmp);
+  return success;
+}
+
+typedef struct {
+  char *path;
+  int64_t mtime;
+  size_t size;
+} file_info_t;
+
+typedef rda_struct(file_info_t) file_infos_t;
+
+/// @internal
+static inline void list_files_push(const char *t_dir, const char *t_name,
+                                   const char *t_ext, file_infos_t *t_files,
+                                   rda_allocator *t_allocator) {
+  size_t dir_len = strlen(t_dir);
+  size_t name_len = strlen(t_name);
+  size_t ext_len = strlen(t_ext);
+  if (name_len < ext_len || strcmp(t_name + name_len - ext_len, t_ext)) {
+    return;
+  }
+  file_info_t info = {.path = nullptr, .mtime = 0, .size = 0};
+  info.path = t_allocator->alloc(t_allocator->m_ctx, dir_len + name_len + 1);
+  memcpy(info.path, t_dir, dir_len);
+  memcpy(info.path + dir_len, t_name, name_len + 1);
+  struct stat st;
+  if (stat(info.path, &st) < 0) return;
+  info.size = st.st_size;
+  file_mtime(info.path, &info.mtime);
+  rda_push_back(*t_files, info, t_allocator);
+}
+
+/// Appends the regular files in `t_dir` whose name ends in `t_ext` to
+/// `t_files`. `t_dir` ends with a separator.
+static inline bool list_files(const char *t_dir, const char *t_ext,
+                              file_infos_t *t_files,
+                              rda_allocator *t_allocator) {
+#if defined(BUILD_WINDOWS)
+  char pattern[MAX_PATH];
+  snprintf(pattern, sizeof(pattern), "%s*%s", t_dir, t_ext);
+  WIN32_FIND_DATAA data;
+  HANDLE find = FindFirstFileA(pattern, &data);
+  if (find == INVALID_HANDLE_VALUE) {
+    return GetLastError() == ERROR_FILE_NOT_FOUND;
+  }
+  do {
+    if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+      list_files_push(t_dir, data.cFileName, t_ext, t_files, t_allocator);
+    }
+  } while (FindNextFileA(find, &data));
+  FindClose(find);
+#else
+  DIR *dir = opendir(t_dir);
+  if (!dir) return false;
+  struct dirent *entry;
+  while ((entry = readdir(dir))) {
+    if (entry->d_type != DT_DIR) {
+      list_files_push(t_dir, entry->d_name, t_ext, t_files, t_allocator);
+    }
+  }
+  closedir(dir);
+#endif  // BUILD_WINDOWS
+  return true;
+}
+
+/// @internal
+static inline int file_info_compare_mtime(const void *t_lhs,
+                                          const void *t_rhs) {
+  int64_t lhs = ((const file_info_t *)t_lhs)->mtime;
+  int64_t rhs = ((const file_info_t *)t_rhs)->mtime;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+/// Removes the least recently used of `t_files` until the rest add up to no
+/// more than `t_max_size` bytes, and returns how many it removed. Whoever
+/// uses a file touches it, so the oldest modification time is the least
+/// recently used. `t_files` is sorted in the process.
+static inline size_t evict_files(file_infos_t *t_files, uint64_t t_max_size) {
+  uint64_t total = 0;
+  rda_for_each(it, (*t_files)) { total += it->size; }
+  if (total <= t_max_size) return 0;
+  qsort(rda_data(*t_files), rda_size(*t_files), sizeof(file_info_t),
+        file_info_compare_mtime);
+  size_t evicted = 0;
+  for (size_t i = 0; i < rda_size(*t_files) && total > t_max_size; ++i) {
+    if (remove(rda_at(*t_files, i).path)) continue;
+    total -= rda_at(*t_files, i).size;
+    ++evicted;
+  }
+  return evicted;
+}
+
+#endif  // FILES_H_INCLUDED
@@ -1,60 +1,157 @@
-#ifndef GENRATOR_H_INCLUDED
+#ifndef GENERATOR_H_INCLUDED
 #define GENERATOR_H_INCLUDED
 
-#include <inttypes.h>
+#include <stdbool.h>
 #include <stdio.h>
 
 #include "defines.h"
+#include "emitter.h"
 #include "libraries/rit_dyn_arr.h"
 #include "libraries/rit_str.h"
 #include "parser.h"
+#include "symbols.h"
 
 /// @internal
-INTERNAL_DEF inline void generate_expr(FILE *t_file, node_expr *t_expr) {
-  switch (t_expr->type) {
-    case expr_num: {
-      fprintf(t_file, "%" PRId64, t_expr->value.num_expr.value);
-      break;
-    }
-    case expr_var: {
-      fprintf(t_file, "%s", rsv_get(t_expr->value.var_expr));
-      break;
+typedef enum {
+  generate_enter,  // Emit the expression
+  generate_op,     // The left operand is done, emit the operator
+  generate_close,  // The parenthesized operand is done, close it
+} generate_state;
+
+/// @internal
+typedef struct {
+  expr_idx idx;
+  generate_state state;
+} generate_frame;
+
+typedef rda_struct(generate_frame) generate_stack;
+
+typedef struct {
+  emitter_t emitter;
+  generate_stack stack;  // Scratch for `generate_expr()`
+  node_prg *prg;
+  symbols_t *symbols;
+} generator_t;
+
+/// @internal
+/// Precedence C gives the operator, higher binds tighter.
+INTERNAL_DEF inline int generate_c_prec(token_type t_op) {
+  return t_op == token_star || t_op == token_fslash ? 2 : 1;
+}
+
+/// @internal
+/// Queues the operand `t_idx` of a binary `t_op`. Thor's binding powers are
+/// C's, so parsed source never needs parentheses, but an operand is still
+/// parenthesized wherever C would group it differently from the tree, like a
+/// right operand of the same precedence.
+INTERNAL_DEF inline void generate_push_operand(generator_t *t_gen,
+                                               token_type t_op, expr_idx t_idx,
+                                               bool t_is_rhs) {
+  emitter_t *emitter = &t_gen->emitter;
+  node_expr *expr = node_prg_expr(t_gen->prg, t_idx);
+  bool paren = false;
+  if (expr->type == expr_bin) {
+    int prec = generate_c_prec(expr->value.bin_expr.op);
+    paren = t_is_rhs ? prec <= generate_c_prec(t_op)
+                     : prec < generate_c_prec(t_op);
+  } else if (expr->type == expr_num) {
+    // Folded constants can be negative, and `a - -1` must not become `a--1`
+    paren = expr->value.num_expr.value < 0;
+  }
+  if (paren) {
+    emit_char(emitter, '(');
+    generate_frame close = {.idx = t_idx, .state = generate_close};
+    rda_push_back(t_gen->stack, close, emitter->allocator);
+  }
+  generate_frame frame = {.idx = t_idx, .state = generate_enter};
+  rda_push_back(t_gen->stack, frame, emitter->allocator);
+}
+
+/// @internal
+/// Emits the expression in-order with an explicit stack, so deep expressions
+/// do not recurse once per operator.
+INTERNAL_DEF inline void generate_expr(generator_t *t_gen, expr_idx t_idx) {
+  emitter_t *emitter = &t_gen->emitter;
+  generate_stack *stack = &t_gen->stack;
+  stack->m_size = 0;
+  generate_frame root = {.idx = t_idx, .state = generate_enter};
+  rda_push_back(*stack, root, emitter->allocator);
+  while (rda_size(*stack) > 0) {
+    generate_frame frame = rda_at(*stack, rda_size(*stack) - 1);
+    stack->m_size--;
+    if (frame.state == generate_close) {
+      emit_char(emitter, ')');
+      continue;
     }
-    case expr_bin: {
-      generate_expr(t_file, t_expr->value.bin_expr.lhs);
-      fprintf(t_file, "%s", token_type_to_str(t_expr->value.bin_expr.op));
-      generate_expr(t_file, t_expr->value.bin_expr.rhs);
-      break;
+    node_expr *expr = node_prg_expr(t_gen->prg, frame.idx);
+    switch (expr->type) {
+      case expr_num: {
+        emit_int64(emitter, expr->value.num_expr.value);
+        break;
+      }
+      case expr_var: {
+        emit_str(emitter, symbols_name(t_gen->symbols, expr->value.var_expr));
+        break;
+      }
+      case expr_bin: {
+        node_bin_expr bin = expr->value.bin_expr;
+        if (frame.state == generate_op) {
+          emit_cstr(emitter, token_type_to_str(bin.op));
+          generate_push_operand(t_gen, bin.op, bin.rhs, true);
+        } else {
+          frame.state = generate_op;
+          rda_push_back(*stack, frame, emitter->allocator);
+          generate_push_operand(t_gen, bin.op, bin.lhs, false);
+        }
+        break;
+      }
     }
   }
 }
 
 /// @internal
-INTERNAL_DEF inline void generate_stmt_exit(FILE *t_file,
+INTERNAL_DEF inline void generate_stmt_exit(generator_t *t_gen,
                                             node_stmt_exit *t_stmt) {
-  fprintf(t_file, "\texit(");
-  generate_expr(t_file, t_stmt->status);
-  fprintf(t_file, ");\n");
+  emit_cstr(&t_gen->emitter, "\texit(");
+  generate_expr(t_gen, t_stmt->status);
+  emit_cstr(&t_gen->emitter, ");\n");
 }
 
-static inline void generate(const char *t_file_name, node_prg *t_prg) {
-  const char *file_name = "out.c";
-  if (t_file_name != nullptr) {
-    file_name = t_file_name;
-  }
-  FILE *file = fopen(file_name, "w");
-  fprintf(file, "#include <stdlib.h>\n");
-  fprintf(file, "int main() {\n");
-  rda_for_each(it, (*t_prg)) {
+/// @internal
+INTERNAL_DEF inline void generate_stmt_var_decl(generator_t *t_gen,
+                                                node_stmt_var_decl *t_stmt) {
+  emit_cstr(&t_gen->emitter, "\tint ");
+  emit_str(&t_gen->emitter, symbols_name(t_gen->symbols, t_stmt->name));
+  emit_char(&t_gen->emitter, '=');
+  generate_expr(t_gen, t_stmt->expr);
+  emit_cstr(&t_gen->emitter, ";\n");
+}
+
+/// Starts generating C into memory, `t_size_hint` is the expected size of the
+/// output.
+static inline void generator_init(generator_t *t_gen, size_t t_size_hint,
+                                  symbols_t *t_symbols,
+                                  rda_allocator *t_allocator) {
+  *t_gen = (generator_t){
+      .emitter = {}, .stack = {}, .prg = nullptr, .symbols = t_symbols};
+  emitter_init(&t_gen->emitter, t_size_hint, t_allocator);
+  rda_init(t_gen->stack, 0, sizeof(generate_frame), t_allocator);
+  emit_cstr(&t_gen->emitter, "#include <stdlib.h>\n");
+  emit_cstr(&t_gen->emitter, "int main() {\n");
+}
+
+/// Generates the statements of `t_prg`, which can be called once per batch
+/// of statements.
+static inline void generate_stmts(generator_t *t_gen, node_prg *t_prg) {
+  t_gen->prg = t_prg;
+  rda_for_each(it, t_prg->stmts) {
     switch (it->type) {
       case stmt_exit: {
-        generate_stmt_exit(file, &(it->value.exit_stmt));
+        generate_stmt_exit(t_gen, &(it->value.exit_stmt));
         break;
       }
       case stmt_var_decl: {
-        fprintf(file, "\tint %s=", rsv_get(it->value.var_decl_stmt.name));
-        generate_expr(file, it->value.var_decl_stmt.expr);
-        fprintf(file, ";\n");
+        generate_stmt_var_decl(t_gen, &(it->value.var_decl_stmt));
         break;
       }
       default: {
@@ -63,8 +160,36 @@ static inline void generate(const char *t_file_name, node_prg *t_prg) {
       }
     }
   }
-  fprintf(file, "}\n");
-  fclose(file);
+}
+
+/// Ends the program, leaving it in the emitter's buffer.
+static inline void generator_close(generator_t *t_gen) {
+  emit_cstr(&t_gen->emitter, "}\n");
+}
+
+/// Ends the program and writes it to `t_file_name` (`out.c` if it is
+/// `nullptr`, stdout if it is `-`) with a single write.
+static inline bool generator_finish(generator_t *t_gen,
+                                    const char *t_file_name) {
+  const char *file_name = "out.c";
+  if (t_file_name != nullptr) {
+    file_name = t_file_name;
+  }
+  generator_close(t_gen);
+  return emitter_write_file(&t_gen->emitter, file_name);
+}
+
+/// Generates C for `t_prg` into memory, then writes it to `t_file_name`
+/// (`out.c` if it is `nullptr`, stdout if it is `-`) with a single write.
+static inline bool generate(const char *t_file_name, node_prg *t_prg,
+                            symbols_t *t_symbols, rda_allocator *t_allocator) {
+  generator_t gen;
+  // Rough upper bound for the common case of short literals and names
+  generator_init(&gen,
+                 rda_size(t_prg->exprs) * 4 + rda_size(t_prg->stmts) * 16 + 64,
+                 t_symbols, t_allocator);
+  generate_stmts(&gen, t_prg);
+  return generator_finish(&gen, t_file_name);
 }
 
 #endif  // GENERATOR_H_INCLUDED
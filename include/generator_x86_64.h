@@ -0,0 +1,231 @@
+#ifndef GENERATOR_X86_64_H_INCLUDED
+#define GENERATOR_X86_64_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "defines.h"
+#include "emitter.h"
+#include "libraries/rit_dyn_arr.h"
+#include "libraries/rit_str.h"
+#include "parser.h"
+#include "symbols.h"
+
+/// @internal
+typedef enum {
+  generate_x86_64_enter,     // Evaluate the expression into %rax
+  generate_x86_64_save_lhs,  // The left operand is in %rax, keep it on the stack
+  generate_x86_64_apply,     // Both operands are ready, apply the operator
+} generate_x86_64_state;
+
+/// @internal
+typedef struct {
+  expr_idx idx;
+  generate_x86_64_state state;
+} generate_x86_64_frame;
+
+typedef struct {
+  emitter_t emitter;
+  rda_struct(generate_x86_64_frame) stack;  // Scratch for expressions
+  uint32_t *slots;  // Symbol id -> stack slot + 1, 0 if not declared yet
+  uint32_t slots_len;
+  node_prg *prg;
+  symbols_t *symbols;
+} generator_x86_64_t;
+
+/// @internal
+/// Operand for the stack slot of `t_sym`, which must be declared.
+INTERNAL_DEF inline void generate_x86_64_slot(generator_x86_64_t *t_gen,
+                                              symbol_id t_sym) {
+  emit_char(&t_gen->emitter, '-');
+  emit_int64(&t_gen->emitter, (int64_t)t_gen->slots[t_sym] * 4);
+  emit_cstr(&t_gen->emitter, "(%rbp)");
+}
+
+/// @internal
+/// Loads a number or a variable into `t_reg`. Variables are 32-bit, like the
+/// `int`s of the C backend, and are sign-extended on load.
+INTERNAL_DEF inline bool generate_x86_64_load(generator_x86_64_t *t_gen,
+                                              node_expr *t_expr,
+                                              const char *t_reg) {
+  emitter_t *emitter = &t_gen->emitter;
+  if (t_expr->type == expr_var) {
+    symbol_id sym = t_expr->value.var_expr;
+    if (!t_gen->slots[sym]) {
+      rsv name = symbols_name(t_gen->symbols, sym);
+      fprintf(stderr, "Error: `%.*s` is used before it is declared\n",
+              (int)rsv_size(name), rsv_get(name));
+      return false;
+    }
+    emit_cstr(emitter, "\tmovslq ");
+    generate_x86_64_slot(t_gen, sym);
+  } else {
+    int64_t value = t_expr->value.num_expr.value;
+    // Immediates wider than 32 bits only fit `movabs`
+    emit_cstr(emitter, value == (int32_t)value ? "\tmov $" : "\tmovabs $");
+    emit_int64(emitter, value);
+  }
+  emit_cstr(emitter, ", ");
+  emit_cstr(emitter, t_reg);
+  emit_char(emitter, '\n');
+  return true;
+}
+
+/// @internal
+/// Computes `%rax = %rax op %rcx` with 64-bit wrapping arithmetic.
+INTERNAL_DEF inline void generate_x86_64_op(generator_x86_64_t *t_gen,
+                                            token_type t_op) {
+  switch (t_op) {
+    case token_plus: {
+      emit_cstr(&t_gen->emitter, "\tadd %rcx, %rax\n");
+      break;
+    }
+    case token_minus: {
+      emit_cstr(&t_gen->emitter, "\tsub %rcx, %rax\n");
+      break;
+    }
+    case token_star: {
+      emit_cstr(&t_gen->emitter, "\timul %rcx, %rax\n");
+      break;
+    }
+    case token_fslash: {
+      // Division by zero traps with SIGFPE, as it does in the C backend
+      emit_cstr(&t_gen->emitter, "\tcqo\n\tidiv %rcx\n");
+      break;
+    }
+    default: {
+      fprintf(stderr, "Error: unknown operator %s\n", token_type_to_str(t_op));
+      exit(1);
+    }
+  }
+}
+
+/// @internal
+/// Evaluates the expression into %rax, walking it with an explicit stack.
+/// Intermediate results are spilled with `push`/`pop`, except when the right
+/// operand is a number or a variable, which is loaded into %rcx directly.
+INTERNAL_DEF inline bool generate_x86_64_expr(generator_x86_64_t *t_gen,
+                                              expr_idx t_idx) {
+  emitter_t *emitter = &t_gen->emitter;
+  t_gen->stack.m_size = 0;
+  generate_x86_64_frame root = {.idx = t_idx, .state = generate_x86_64_enter};
+  rda_push_back(t_gen->stack, root, emitter->allocator);
+  while (rda_size(t_gen->stack) > 0) {
+    generate_x86_64_frame frame =
+        rda_at(t_gen->stack, rda_size(t_gen->stack) - 1);
+    t_gen->stack.m_size--;
+    node_expr *expr = node_prg_expr(t_gen->prg, frame.idx);
+    if (expr->type != expr_bin) {
+      if (!generate_x86_64_load(t_gen, expr, "%rax")) return false;
+      continue;
+    }
+    node_bin_expr bin = expr->value.bin_expr;
+    node_expr *rhs = node_prg_expr(t_gen->prg, bin.rhs);
+    switch (frame.state) {
+      case generate_x86_64_enter: {
+        frame.state = rhs->type == expr_bin ? generate_x86_64_save_lhs
+                                            : generate_x86_64_apply;
+        rda_push_back(t_gen->stack, frame, emitter->allocator);
+        generate_x86_64_frame lhs = {.idx = bin.lhs,
+                                     .state = generate_x86_64_enter};
+        rda_push_back(t_gen->stack, lhs, emitter->allocator);
+        break;
+      }
+      case generate_x86_64_save_lhs: {
+        emit_cstr(emitter, "\tpush %rax\n");
+        frame.state = generate_x86_64_apply;
+        rda_push_back(t_gen->stack, frame, emitter->allocator);
+        generate_x86_64_frame rhs_frame = {.idx = bin.rhs,
+                                           .state = generate_x86_64_enter};
+        rda_push_back(t_gen->stack, rhs_frame, emitter->allocator);
+        break;
+      }
+      case generate_x86_64_apply: {
+        if (rhs->type == expr_bin) {
+          emit_cstr(emitter, "\tmov %rax, %rcx\n\tpop %rax\n");
+        } else if (!generate_x86_64_load(t_gen, rhs, "%rcx")) {
+          return false;
+        }
+        generate_x86_64_op(t_gen, bin.op);
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+/// Generates x86-64 assembly (GNU as, AT&T syntax) for Linux into memory,
+/// then writes it to `t_file_name` (`out.s` if it is `nullptr`, stdout if it
+/// is `-`). The program is a freestanding `_start` that ends with the `exit`
+/// syscall, so it needs no libc and links with a bare `ld`:
+///
+///     as out.s -o out.o && ld out.o -o out
+static inline bool generate_x86_64(const char *t_file_name, node_prg *t_prg,
+                                   symbols_t *t_symbols,
+                                   rda_allocator *t_allocator) {
+  const char *file_name = "out.s";
+  if (t_file_name != nullptr) {
+    file_name = t_file_name;
+  }
+  generator_x86_64_t gen = {.emitter = {},
+                            .stack = {},
+                            .slots = nullptr,
+                            .slots_len = 0,
+                            .prg = t_prg,
+                            .symbols = t_symbols};
+  // Rough upper bound, most nodes become a single instruction
+  emitter_init(&gen.emitter,
+               rda_size(t_prg->exprs) * 24 + rda_size(t_prg->stmts) * 32 + 128,
+               t_allocator);
+  rda_init(gen.stack, 0, sizeof(generate_x86_64_frame), t_allocator);
+  size_t slots_size = symbols_size(t_symbols) * sizeof(uint32_t);
+  gen.slots = t_allocator->alloc(t_allocator->m_ctx, slots_size);
+  memset(gen.slots, 0, slots_size);
+  // Every declaration gets a 4 byte slot below %rbp
+  size_t frame_size = 0;
+  rda_for_each(it, t_prg->stmts) {
+    if (it->type == stmt_var_decl) frame_size += 4;
+  }
+  frame_size = (frame_size + 15) & ~(size_t)15;
+
+  emit_cstr(&gen.emitter, "\t.text\n\t.globl _start\n_start:\n");
+  emit_cstr(&gen.emitter, "\tmov %rsp, %rbp\n");
+  if (frame_size > 0) {
+    emit_cstr(&gen.emitter, "\tsub $");
+    emit_int64(&gen.emitter, (int64_t)frame_size);
+    emit_cstr(&gen.emitter, ", %rsp\n");
+  }
+  rda_for_each(it, t_prg->stmts) {
+    switch (it->type) {
+      case stmt_exit: {
+        if (!generate_x86_64_expr(&gen, it->value.exit_stmt.status)) {
+          return false;
+        }
+        emit_cstr(&gen.emitter, "\tmov %eax, %edi\n\tmov $60, %eax\n");
+        emit_cstr(&gen.emitter, "\tsyscall\n");
+        break;
+      }
+      case stmt_var_decl: {
+        node_stmt_var_decl *decl = &it->value.var_decl_stmt;
+        if (!generate_x86_64_expr(&gen, decl->expr)) return false;
+        // A redeclaration reuses the slot of the first one
+        if (!gen.slots[decl->name]) gen.slots[decl->name] = ++gen.slots_len;
+        emit_cstr(&gen.emitter, "\tmov %eax, ");
+        generate_x86_64_slot(&gen, decl->name);
+        emit_char(&gen.emitter, '\n');
+        break;
+      }
+      default: {
+        fprintf(stderr, "Error: unknown statment type\n");
+        exit(1);
+      }
+    }
+  }
+  // Falling off the end exits with 0, like returning from C's `main()`
+  emit_cstr(&gen.emitter, "\txor %edi, %edi\n\tmov $60, %eax\n\tsyscall\n");
+  return emitter_write_file(&gen.emitter, file_name);
+}
+
+#endif  // GENERATOR_X86_64_H_INCLUDED
@@ -0,0 +1,34 @@
+#ifndef JIT_H_INCLUDED
+#define JIT_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defines.h"
+#include "libraries/rit_dyn_arr.h"
+#include "parser.h"
+#include "symbols.h"
+
+#if defined(BUILD_LINUX) && defined(__x86_64__)
+#define JIT_SUPPORTED
+#endif
+
+/// x86-64 machine code for a `node_prg`, compiled into a single function
+/// `int f(int64_t *frame)`. Variables and spilled temporaries live in `frame`
+/// rather than on the machine stack, so deep expressions cannot overflow it.
+typedef struct {
+  rda_struct(uint8_t) code;
+  size_t frame_size;  // In bytes
+} jit_program;
+
+/// Returns false if `t_prg` uses a variable before declaring it, or if the JIT
+/// is not supported on this platform.
+bool jit_compile(jit_program *t_jit_prg, node_prg *t_prg, symbols_t *t_symbols,
+                 rda_allocator *t_allocator);
+
+/// Maps the code executable, runs it and stores the status the program exits
+/// with. A division by zero traps with SIGFPE, as in the generated C.
+bool jit_run(jit_program *t_jit_prg, int *t_status, rda_allocator *t_allocator);
+
+#endif  // JIT_H_INCLUDED
@@ -0,0 +1,28 @@
+#ifndef OPTIMIZER_H_INCLUDED
+#define OPTIMIZER_H_INCLUDED
+
+#include "defines.h"
+#include "libraries/rit_dyn_arr.h"
+#include "parser.h"
+#include "symbols.h"
+#include "timer.h"
+
+typedef enum {
+  opt_level_0,  // Generate the program as written
+  opt_level_1,  // Fold and propagate constants, drop dead declarations
+} opt_level;
+
+/// Rewrites `t_prg` in place for `t_level`. Only run it on a program that
+/// parsed without errors.
+///
+/// At `opt_level_1`, binary expressions whose operands are both numbers are
+/// folded into a number, and variables declared with a constant are replaced
+/// by that constant in later uses. A declaration that no later statement
+/// reads is dropped, unless its expression could still trap at run time.
+///
+/// Each pass is timed into `t_timers` unless it is `nullptr`.
+void optimize(node_prg *t_prg, symbols_t *t_symbols,
+              rda_allocator *t_allocator, opt_level t_level,
+              timer_passes_t *t_timers);
+
+#endif  // OPTIMIZER_H_INCLUDED
@@ -8,47 +8,50 @@
 #include "defines.h"
 #include "libraries/rit_dyn_arr.h"
 #include "libraries/rit_str.h"
+#include "symbols.h"
+#include "timer.h"
 #include "tokenizer.h"
 
+/// Operators of the same binding power group left to right, as in C, so
+/// `a - b + c` is `(a - b) + c`.
 typedef enum {
   bp_default,
-  bp_sub,
-  bp_add,
-  bp_mul,
-  bp_div,
+  bp_sum,      // `+` and `-`
+  bp_product,  // `*` and `/`
   bp_primary
 } binding_power;
 typedef enum { stmt_exit, stmt_var_decl } node_stmt_type;
 typedef enum { expr_num, expr_var, expr_bin } node_expr_type;
 
-typedef struct node_expr node_expr;
+/// Index of a node in `node_prg.exprs`.
+typedef uint32_t expr_idx;
 
 typedef struct {
   int64_t value;
 } node_num_expr;
 
 typedef struct {
-  node_expr *lhs;
-  node_expr *rhs;
+  expr_idx lhs;
+  expr_idx rhs;
   token_type op;
 } node_bin_expr;
 
-struct node_expr {
+typedef struct {
   union {
     node_num_expr num_expr;
     node_bin_expr bin_expr;
-    rsv var_expr;
+    symbol_id var_expr;
   } value;
   node_expr_type type;
-};
+} node_expr;
 
 typedef struct {
-  node_expr *status;
+  expr_idx status;
 } node_stmt_exit;
 
 typedef struct {
-  rsv name;
-  node_expr *expr;
+  symbol_id name;
+  expr_idx expr;
 } node_stmt_var_decl;
 
 typedef struct {
@@ -59,20 +62,96 @@ typedef struct {
   node_stmt_type type;
 } node_stmt;
 
-typedef rda_struct(node_stmt) node_prg;
+typedef rda_struct(node_expr) node_exprs_t;
+typedef rda_struct(node_stmt) node_stmts_t;
+
+/// The AST lives in two contiguous pools addressed by index. The program is
+/// the statements in `stmts[0, size)`, in source order. Each statement's
+/// expression is a contiguous range of `exprs` laid out in post-order, so
+/// children always have smaller indices than their parent and the root comes
+/// last.
+typedef struct {
+  node_exprs_t exprs;
+  node_stmts_t stmts;
+} node_prg;
+
+static inline node_expr *node_prg_expr(node_prg *t_prg, expr_idx t_idx) {
+  return &rda_data(t_prg->exprs)[t_idx];
+}
+
+/// Evaluates `t_lhs t_op t_rhs` with 64-bit wrapping arithmetic. Returns false
+/// if the result is not defined (division by zero or `INT64_MIN / -1`), those
+/// are left for the program to trap on at run time.
+static inline bool node_bin_eval(token_type t_op, int64_t t_lhs, int64_t t_rhs,
+                                 int64_t *t_result) {
+  uint64_t lhs = (uint64_t)t_lhs;
+  uint64_t rhs = (uint64_t)t_rhs;
+  switch (t_op) {
+    case token_plus: {
+      *t_result = (int64_t)(lhs + rhs);
+      return true;
+    }
+    case token_minus: {
+      *t_result = (int64_t)(lhs - rhs);
+      return true;
+    }
+    case token_star: {
+      *t_result = (int64_t)(lhs * rhs);
+      return true;
+    }
+    case token_fslash: {
+      if (t_rhs == 0 || (t_lhs == INT64_MIN && t_rhs == -1)) return false;
+      *t_result = t_lhs / t_rhs;
+      return true;
+    }
+    default: {
+      return false;
+    }
+  }
+}
+
+/// Number of expressions and statements, the nodes of the program.
+static inline size_t node_prg_size(node_prg *t_prg) {
+  return rda_size(t_prg->exprs) + rda_size(t_prg->stmts);
+}
+
+/// Drops every node but keeps the pools' memory for reuse.
+static inline void node_prg_reset(node_prg *t_prg) {
+  t_prg->exprs.m_size = 0;
+  t_prg->stmts.m_size = 0;
+}
+
+/// A binary expression waiting for its right operand, see `parse_expr()`.
+typedef struct {
+  expr_idx lhs;
+  token_type op;
+  binding_power min_bp;
+} parser_expr_frame;
 
 typedef struct {
   size_t idx;
   node_prg prg;
+  rda_struct(parser_expr_frame) expr_frames;  // Scratch for `parse_expr()`
   rda_allocator *allocator;
+  bool owns_allocator;  // Whether `parser_deinit()` frees the arena
   tokenizer_t *tokenizer;
 } parser_t;
 
-#define parser_create(t_parser_name, t_file) \
-  parser_t t_parser_name = parser_init(t_file)
+void node_prg_init(node_prg *t_prg, rda_allocator *t_allocator);
 
-parser_t parser_init(const char *t_file);
-void parse(parser_t *t_parser);
+/// Tokenizes `t_file` into a new arena, which `parser_deinit()` frees.
+/// Returns false if `t_file` cannot be read, there is nothing to free then.
+bool parser_init(parser_t *t_parser, const char *t_file);
+/// Tokenizes `t_file` using `t_allocator`, which the caller keeps owning and
+/// may reset after `parser_deinit()`. With `t_lex_jobs` above 1, the file is
+/// lexed by `tokenize_parallel()` on that many threads. Reading and lexing
+/// are timed into `t_timers` unless it is `nullptr`. Returns false, having
+/// reported why, if `t_file` cannot be read; `parser_deinit()` must not be
+/// called then.
+bool parser_init_with_allocator(parser_t *t_parser, const char *t_file,
+                                size_t t_lex_jobs, timer_passes_t *t_timers,
+                                rda_allocator *t_allocator);
+bool parse(parser_t *t_parser);
 void parser_deinit(parser_t *t_parser);
 
 #endif  // PARSER_H_INCLUDED
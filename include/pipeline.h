@@ -0,0 +1,16 @@
+#ifndef PIPELINE_H_INCLUDED
+#define PIPELINE_H_INCLUDED
+
+#include <stdbool.h>
+
+/// Compiles `t_file` to C in `t_out_file` (`nullptr` for `out.c`) with the
+/// lexer, the parser and the generator running at the same time on three
+/// threads. Batches of tokens flow from the lexer to the parser, and batches
+/// of finished statements from the parser to the generator, through two
+/// lock-free single-producer/single-consumer rings.
+///
+/// The output is the same as `compile_file()` at `opt_level_0`, the
+/// optimizer needs the whole program and is not run.
+bool compile_file_pipelined(const char *t_file, const char *t_out_file);
+
+#endif  // PIPELINE_H_INCLUDED
@@ -3,15 +3,26 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "defines.h"
 #include "libraries/rit_dyn_arr.h"
 #include "libraries/rit_str.h"
 
+#include "files.h"
+
 #if defined(BUILD_WINDOWS)
+#include <sys/stat.h>
+#include <sys/types.h>
+
 typedef HANDLE cmd_proc_t;
 #define CMD_INVALID_PROC INVALID_HANDLE_VALUE
 #else
+#include <time.h>
+
 typedef int cmd_proc_t;
 #define CMD_INVALID_PROC (-1)
 #endif  // BUILD_WINDOWS
@@ -155,7 +166,7 @@ static inline bool cmd_proc_wait(cmd_proc_t t_proc) {
       int exit_status = WEXITSTATUS(wstatus);
       if (exit_status != 0) {
         fprintf(stderr, "Command exited with exit code: %d\n", exit_status);
-        return 1;
+        return false;
       }
       break;
     }
@@ -196,4 +207,145 @@ static inline bool make_dir(const char *t_path) {
   return true;
 }
 
+/// Number of cores, to know how many commands to run at once.
+static inline size_t cpu_count(void) {
+#if defined(BUILD_WINDOWS)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (size_t)count : 1;
+#endif  // BUILD_WINDOWS
+}
+
+/// Nanoseconds on a monotonic clock, to time commands.
+static inline uint64_t clock_now_ns(void) {
+#if defined(BUILD_WINDOWS)
+  LARGE_INTEGER counter;
+  LARGE_INTEGER frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (uint64_t)((double)counter.QuadPart * 1e9 /
+                    (double)frequency.QuadPart);
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif  // BUILD_WINDOWS
+}
+
+/// Whether `t_obj` is newer than every file that the depfile `t_dep_file`,
+/// written by `-MMD`, lists it as depending on. The source is one of them.
+/// A missing object, depfile or dependency means the object is out of date.
+static inline bool depfile_up_to_date(const char *t_obj,
+                                      const char *t_dep_file) {
+  int64_t obj_mtime;
+  if (!file_mtime(t_obj, &obj_mtime)) return false;
+  FILE *file = fopen(t_dep_file, "rb");
+  if (!file) return false;
+  size_t len = 0;
+  size_t size = 4096;
+  char *deps = malloc(size);
+  size_t read;
+  while ((read = fread(deps + len, 1, size - len - 1, file)) > 0) {
+    len += read;
+    if (len + 1 == size) {
+      size *= 2;
+      deps = realloc(deps, size);
+    }
+  }
+  fclose(file);
+  deps[len] = '\0';
+
+  // `obj: dep dep \<newline> dep`, the rules `-MP` adds after it are skipped
+  char *it = deps;
+  while (*it && !(it[0] == ':' && (it[1] == ' ' || it[1] == '\t'))) ++it;
+  bool up_to_date = *it != '\0';
+  if (up_to_date) ++it;
+  while (up_to_date && *it && *it != '\n') {
+    if (*it == ' ' || *it == '\t' || *it == '\r') {
+      ++it;
+    } else if (it[0] == '\\' && (it[1] == '\n' || it[1] == '\r')) {
+      it += it[1] == '\r' && it[2] == '\n' ? 3 : 2;
+    } else {
+      char *dep = it;
+      while (*it && !strchr(" \t\r\n", *it)) ++it;
+      char end = *it;
+      *it = '\0';
+      int64_t dep_mtime;
+      up_to_date = file_mtime(dep, &dep_mtime) && dep_mtime <= obj_mtime;
+      *it = end;
+    }
+  }
+  free(deps);
+  return up_to_date;
+}
+
+/// Runs the `t_len` commands of `t_cmds`, `t_jobs` of them at a time.
+/// Returns whether they all succeeded, none is started after one failed.
+static inline bool cmd_run_parallel(cmd_t *t_cmds, size_t t_len,
+                                    size_t t_jobs) {
+  cmd_proc_t *procs = malloc(t_jobs * sizeof(cmd_proc_t));
+  size_t started = 0;
+  size_t waited = 0;
+  bool success = true;
+  while (waited < started || (success && started < t_len)) {
+    if (success && started < t_len && started - waited < t_jobs) {
+      procs[started % t_jobs] = cmd_run_async(t_cmds[started]);
+      ++started;
+    } else {
+      // The oldest command, once `t_jobs` of them are running
+      success = cmd_proc_wait(procs[waited % t_jobs]) && success;
+      ++waited;
+    }
+  }
+  free(procs);
+  return success;
+}
+
+/// Folds what `t_cmd` prints into `t_hash`, like a compiler's version. The
+/// command goes through the shell, which still starts when the command does
+/// not exist, so printing nothing counts as a failure too.
+static inline bool hash_cmd_output(uint64_t *t_hash, const char *t_cmd) {
+#if defined(BUILD_WINDOWS)
+  FILE *out = _popen(t_cmd, "r");
+#else
+  FILE *out = popen(t_cmd, "r");
+#endif  // BUILD_WINDOWS
+  if (!out) return false;
+  char buf[4096];
+  size_t read;
+  size_t total = 0;
+  while ((read = fread(buf, 1, sizeof(buf), out)) > 0) {
+    *t_hash = hash_bytes(*t_hash, buf, read);
+    total += read;
+  }
+#if defined(BUILD_WINDOWS)
+  return _pclose(out) != -1 && total > 0;
+#else
+  return pclose(out) != -1 && total > 0;
+#endif  // BUILD_WINDOWS
+}
+
+/// Whether `t_path` holds exactly `t_str`.
+static inline bool file_equals_str(const char *t_path, const char *t_str) {
+  FILE *file = fopen(t_path, "rb");
+  if (!file) return false;
+  size_t len = strlen(t_str);
+  char *contents = malloc(len + 1);
+  size_t read = fread(contents, 1, len + 1, file);
+  fclose(file);
+  bool equal = read == len && !memcmp(contents, t_str, len);
+  free(contents);
+  return equal;
+}
+
+static inline bool file_write_str(const char *t_path, const char *t_str) {
+  FILE *file = fopen(t_path, "wb");
+  if (!file) return false;
+  bool success = fputs(t_str, file) >= 0;
+  return !fclose(file) && success;
+}
+
 #endif  // BUILD_H_INCLUDED
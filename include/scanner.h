@@ -0,0 +1,23 @@
+#ifndef SCANNER_H_INCLUDED
+#define SCANNER_H_INCLUDED
+
+#include <stddef.h>
+
+/// Returns the index of the first byte at or after `t_idx` that does not
+/// belong to the run, or `t_size` if the run reaches the end of the buffer.
+typedef size_t (*scanner_fn)(const char *t_buf, size_t t_idx, size_t t_size);
+
+/// Kernels used by the tokenizer to skip over whole runs of bytes at once.
+/// `scanner_select()` picks the widest implementation the CPU supports at
+/// runtime: AVX2 (32 bytes per step), SSE2 (16 bytes per step) or scalar.
+typedef struct {
+  scanner_fn skip_space;   // ' ' and '\r'
+  scanner_fn skip_ident;   // [A-Za-z0-9]
+  scanner_fn skip_digits;  // [0-9]
+  const char *name;
+} scanner_t;
+
+scanner_t scanner_select(void);
+scanner_t scanner_scalar(void);
+
+#endif  // SCANNER_H_INCLUDED
@@ -0,0 +1,30 @@
+#ifndef SOURCE_H_INCLUDED
+#define SOURCE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "defines.h"
+#include "libraries/rit_str.h"
+
+/// A read-only view of a source file. Regular files are memory-mapped, so
+/// lexing can start without copying the input and the pages are shared with
+/// the page cache. Pipes, character devices and stdin (`-`) cannot be mapped,
+/// those are streamed into an arena string instead.
+typedef struct {
+  rsv view;
+  void *map;  // Base of the mapping, `nullptr` when `view` is not mapped
+  size_t map_size;
+#if defined(BUILD_WINDOWS)
+  HANDLE file;
+  HANDLE mapping;
+#endif  // BUILD_WINDOWS
+} source_t;
+
+#define SOURCE_STDIN "-"
+
+bool source_open(source_t *t_source, const char *t_file,
+                 rstr_allocator *t_allocator);
+void source_close(source_t *t_source);
+
+#endif  // SOURCE_H_INCLUDED
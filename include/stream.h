@@ -0,0 +1,17 @@
+#ifndef STREAM_H_INCLUDED
+#define STREAM_H_INCLUDED
+
+#include <stdbool.h>
+
+/// Compiles `t_file` (`-` for stdin) to C in `t_out_file` (`nullptr` for
+/// `out.c`, `-` for stdout) in constant memory. The source is read through a
+/// window of whole lines, and each window is lexed, parsed and generated
+/// before the next one is read, reusing the same arrays every time. Only the
+/// symbol table grows, with the number of distinct names.
+///
+/// The output is the same as `compile_file()` at `opt_level_0`, the
+/// optimizer needs the whole program and is not run. If the program has
+/// errors, the partial output file is removed.
+bool compile_file_streamed(const char *t_file, const char *t_out_file);
+
+#endif  // STREAM_H_INCLUDED
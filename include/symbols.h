@@ -0,0 +1,65 @@
+#ifndef SYMBOLS_H_INCLUDED
+#define SYMBOLS_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defines.h"
+#include "libraries/rit_dyn_arr.h"
+#include "libraries/rit_str.h"
+
+typedef uint32_t symbol_id;
+
+/// Keywords are interned first, so their ids are known up front and a
+/// keyword is recognized by the same lookup that interns identifiers.
+typedef enum {
+  symbol_exit,
+  symbol_keywords_len,
+} symbol_keyword;
+
+/// Interns identifiers into dense ids, so later passes compare integers
+/// instead of strings. Each distinct name is copied once into the allocator,
+/// and looked up through an open-addressing (linear probing) hash table.
+typedef struct {
+  rda_struct(rsv) names;        // id -> name
+  rda_struct(uint32_t) hashes;  // id -> hash, so growing never rehashes names
+  uint32_t *slots;              // id + 1 of the symbol in each slot, 0 if empty
+  size_t slots_len;             // Always a power of two
+  rstr_allocator *allocator;
+} symbols_t;
+
+void symbols_init(symbols_t *t_symbols, rstr_allocator *t_allocator);
+symbol_id symbols_intern_hashed(symbols_t *t_symbols, const char *t_str,
+                                size_t t_len, uint32_t t_hash);
+
+/// FNV-1a
+static inline uint32_t symbols_hash(const char *t_str, size_t t_len) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < t_len; ++i) {
+    hash = (hash ^ (unsigned char)t_str[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static inline symbol_id symbols_intern(symbols_t *t_symbols, const char *t_str,
+                                       size_t t_len) {
+  return symbols_intern_hashed(t_symbols, t_str, t_len,
+                               symbols_hash(t_str, t_len));
+}
+
+/// Gives `t_name` the next id without hashing or copying it. This is for a
+/// table that mirrors ids interned by another thread and is only used to look
+/// names up, as in the pipelined compiler.
+static inline void symbols_push_name(symbols_t *t_symbols, rsv t_name) {
+  rda_push_back(t_symbols->names, t_name, t_symbols->allocator);
+}
+
+static inline rsv symbols_name(symbols_t *t_symbols, symbol_id t_id) {
+  return rda_at(t_symbols->names, t_id);
+}
+
+static inline size_t symbols_size(symbols_t *t_symbols) {
+  return rda_size(t_symbols->names);
+}
+
+#endif  // SYMBOLS_H_INCLUDED
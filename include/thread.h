@@ -0,0 +1,203 @@
+#ifndef THREAD_H_INCLUDED
+#define THREAD_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defines.h"
+
+#if defined(BUILD_WINDOWS)
+typedef HANDLE thread_t;
+#else
+#include <pthread.h>
+#include <sched.h>
+typedef pthread_t thread_t;
+#endif  // BUILD_WINDOWS
+
+typedef void (*thread_fn)(void *t_arg);
+
+/// @internal
+/// The entry points of pthreads and Win32 threads have different signatures,
+/// so every thread starts here and calls the `thread_fn` it was given.
+typedef struct {
+  thread_fn fn;
+  void *arg;
+} thread_start;
+
+#if defined(BUILD_WINDOWS)
+/// @internal
+INTERNAL_DEF inline DWORD WINAPI thread_trampoline(LPVOID t_start) {
+#else
+/// @internal
+INTERNAL_DEF inline void *thread_trampoline(void *t_start) {
+#endif  // BUILD_WINDOWS
+  thread_start start = *(thread_start *)t_start;
+  free(t_start);
+  start.fn(start.arg);
+  return 0;
+}
+
+static inline bool thread_create(thread_t *t_thread, thread_fn t_fn,
+                                 void *t_arg) {
+  thread_start *start = malloc(sizeof(thread_start));
+  start->fn = t_fn;
+  start->arg = t_arg;
+#if defined(BUILD_WINDOWS)
+  *t_thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+  if (*t_thread == NULL) {
+    fprintf(stderr, "Error: could not create thread: %lu\n", GetLastError());
+    free(start);
+    return false;
+  }
+#else
+  int result = pthread_create(t_thread, NULL, thread_trampoline, start);
+  if (result != 0) {
+    fprintf(stderr, "Error: could not create thread: %s\n", strerror(result));
+    free(start);
+    return false;
+  }
+#endif  // BUILD_WINDOWS
+  return true;
+}
+
+static inline void thread_join(thread_t t_thread) {
+#if defined(BUILD_WINDOWS)
+  WaitForSingleObject(t_thread, INFINITE);
+  CloseHandle(t_thread);
+#else
+  pthread_join(t_thread, NULL);
+#endif  // BUILD_WINDOWS
+}
+
+/// Number of cores available to the process, at least 1.
+static inline size_t thread_hardware_concurrency(void) {
+#if defined(BUILD_WINDOWS)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  size_t cores = info.dwNumberOfProcessors;
+#else
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+#endif  // BUILD_WINDOWS
+  return cores > 0 ? (size_t)cores : 1;
+}
+
+/// Atomically adds `t_value` to `*t_ptr` and returns the previous value.
+static inline size_t thread_atomic_fetch_add(size_t *t_ptr, size_t t_value) {
+#if defined(_MSC_VER)
+  return (size_t)InterlockedExchangeAdd64((volatile LONG64 *)t_ptr,
+                                          (LONG64)t_value);
+#else
+  return __atomic_fetch_add(t_ptr, t_value, __ATOMIC_RELAXED);
+#endif  // _MSC_VER
+}
+
+static inline void thread_atomic_add_u64(uint64_t *t_ptr, uint64_t t_value) {
+#if defined(_MSC_VER)
+  InterlockedExchangeAdd64((volatile LONG64 *)t_ptr, (LONG64)t_value);
+#else
+  __atomic_fetch_add(t_ptr, t_value, __ATOMIC_RELAXED);
+#endif  // _MSC_VER
+}
+
+/// Atomically raises `*t_ptr` to `t_value` if it is below it.
+static inline void thread_atomic_max_u64(uint64_t *t_ptr, uint64_t t_value) {
+#if defined(_MSC_VER)
+  LONG64 seen = *(volatile LONG64 *)t_ptr;
+  while ((uint64_t)seen < t_value) {
+    LONG64 prev = InterlockedCompareExchange64((volatile LONG64 *)t_ptr,
+                                               (LONG64)t_value, seen);
+    if (prev == seen) break;
+    seen = prev;
+  }
+#else
+  uint64_t seen = __atomic_load_n(t_ptr, __ATOMIC_RELAXED);
+  while (seen < t_value &&
+         !__atomic_compare_exchange_n(t_ptr, &seen, t_value, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+#endif  // _MSC_VER
+}
+
+static inline void thread_atomic_store_bool(bool *t_ptr, bool t_value) {
+#if defined(_MSC_VER)
+  InterlockedExchange8((volatile char *)t_ptr, (char)t_value);
+#else
+  __atomic_store_n(t_ptr, t_value, __ATOMIC_RELAXED);
+#endif  // _MSC_VER
+}
+
+static inline size_t thread_atomic_load_acquire(size_t *t_ptr) {
+#if defined(_MSC_VER)
+  // Aligned loads are atomic on x86 and x64, the barrier orders the rest
+  size_t value = *(volatile size_t *)t_ptr;
+  _ReadWriteBarrier();
+  return value;
+#else
+  return __atomic_load_n(t_ptr, __ATOMIC_ACQUIRE);
+#endif  // _MSC_VER
+}
+
+static inline void thread_atomic_store_release(size_t *t_ptr, size_t t_value) {
+#if defined(_MSC_VER)
+  _ReadWriteBarrier();
+  *(volatile size_t *)t_ptr = t_value;
+#else
+  __atomic_store_n(t_ptr, t_value, __ATOMIC_RELEASE);
+#endif  // _MSC_VER
+}
+
+/// Gives the rest of the time slice to another thread.
+static inline void thread_yield(void) {
+#if defined(BUILD_WINDOWS)
+  SwitchToThread();
+#else
+  sched_yield();
+#endif  // BUILD_WINDOWS
+}
+
+/// Lock-free ring of `len` slots (a power of two) between exactly one
+/// producer and one consumer thread. It only hands out slot indices, the
+/// slots themselves live in an array next to it and keep their memory from
+/// one lap to the next. Each side spins, yielding, while the ring is full or
+/// empty.
+typedef struct {
+  size_t head;  // Next slot to consume, only written by the consumer
+  size_t tail;  // Next slot to produce, only written by the producer
+  size_t len;
+} thread_ring;
+
+/// Waits for a free slot and returns its index, fill it then call
+/// `thread_ring_push()`.
+static inline size_t thread_ring_reserve(thread_ring *t_ring) {
+  size_t tail = t_ring->tail;
+  while (tail - thread_atomic_load_acquire(&t_ring->head) == t_ring->len) {
+    thread_yield();
+  }
+  return tail & (t_ring->len - 1);
+}
+
+/// Hands the reserved slot to the consumer.
+static inline void thread_ring_push(thread_ring *t_ring) {
+  thread_atomic_store_release(&t_ring->tail, t_ring->tail + 1);
+}
+
+/// Waits for a filled slot and returns its index, release it with
+/// `thread_ring_pop()` once done with it.
+static inline size_t thread_ring_peek(thread_ring *t_ring) {
+  size_t head = t_ring->head;
+  while (thread_atomic_load_acquire(&t_ring->tail) == head) {
+    thread_yield();
+  }
+  return head & (t_ring->len - 1);
+}
+
+/// Gives the slot back to the producer.
+static inline void thread_ring_pop(thread_ring *t_ring) {
+  thread_atomic_store_release(&t_ring->head, t_ring->head + 1);
+}
+
+#endif  // THREAD_H_INCLUDED
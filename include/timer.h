@@ -0,0 +1,117 @@
+#ifndef TIMER_H_INCLUDED
+#define TIMER_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "allocator.h"
+#include "defines.h"
+
+#if !defined(BUILD_WINDOWS)
+#include <time.h>
+#endif  // BUILD_WINDOWS
+
+/// Phases of a compilation that `--time-passes` reports, in the order they
+/// run.
+typedef enum {
+  timer_read,        // Opening the source, mapping it when it can be
+  timer_lex,         // Also pays for faulting in the mapped source
+  timer_parse,
+  timer_fold,        // Constant folding and propagation
+  timer_dead_decls,  // Dropping unused declarations
+  timer_generate,    // C, assembly, bytecode or machine code
+  timer_execute,     // Running the program, for `thor run`
+  timer_passes_len,
+} timer_pass;
+
+/// What a phase counts to report its throughput.
+typedef enum {
+  timer_unit_none,
+  timer_unit_bytes,
+  timer_unit_tokens,
+  timer_unit_nodes,
+} timer_unit;
+
+/// What went through the allocator during a phase, for `--mem-stats`.
+typedef struct {
+  uint64_t allocs;     // Calls to `alloc()` and `realloc()`
+  uint64_t requested;  // Bytes asked for
+  uint64_t moved;      // Bytes wasted by `realloc()` moving a block
+  uint64_t blocks;     // Arena blocks allocated
+  uint64_t peak;       // Arena footprint high-water mark when the phase ended,
+                       // of the largest arena in a batch
+} timer_memory;
+
+/// Time spent and items processed in each phase. Phases that run more than
+/// once, like every file of a batch, add up.
+///
+/// With `counter` and `arena` set, the allocations of each phase are also
+/// recorded in `memory`. `counter` must wrap the allocator of `arena`.
+typedef struct {
+  uint64_t ns[timer_passes_len];
+  uint64_t items[timer_passes_len];
+  timer_memory memory[timer_passes_len];
+  allocator_counter_t *counter;
+  arena_allocator_t *arena;
+  allocator_counter_t counter_mark;  // `*counter` when the phase started
+  size_t blocks_mark;                // `arena->blocks` when it started
+} timer_passes_t;
+
+/// Nanoseconds on a monotonic clock, only differences are meaningful.
+static inline uint64_t timer_now(void) {
+#if defined(BUILD_WINDOWS)
+  LARGE_INTEGER counter;
+  LARGE_INTEGER frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (uint64_t)((double)counter.QuadPart * 1e9 /
+                    (double)frequency.QuadPart);
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif  // BUILD_WINDOWS
+}
+
+/// Starts timing a phase, `t_timers` is `nullptr` when timing is off, in which
+/// case the clock is not read at all. Phases do not nest.
+static inline uint64_t timer_start(timer_passes_t *t_timers) {
+  if (!t_timers) return 0;
+  if (t_timers->counter) {
+    t_timers->counter_mark = *t_timers->counter;
+    t_timers->blocks_mark = t_timers->arena->blocks;
+  }
+  return timer_now();
+}
+
+/// Adds the time since `t_start` and `t_items` to `t_pass`.
+static inline void timer_stop(timer_passes_t *t_timers, timer_pass t_pass,
+                              uint64_t t_start, size_t t_items) {
+  if (!t_timers) return;
+  t_timers->ns[t_pass] += timer_now() - t_start;
+  t_timers->items[t_pass] += t_items;
+  if (t_timers->counter) {
+    allocator_counter_t *counter = t_timers->counter;
+    timer_memory *memory = &t_timers->memory[t_pass];
+    memory->allocs += counter->allocs - t_timers->counter_mark.allocs;
+    memory->requested += counter->requested - t_timers->counter_mark.requested;
+    memory->moved += counter->moved - t_timers->counter_mark.moved;
+    memory->blocks += t_timers->arena->blocks - t_timers->blocks_mark;
+    if (t_timers->arena->peak > memory->peak) {
+      memory->peak = t_timers->arena->peak;
+    }
+  }
+}
+
+/// Adds `t_src` to `t_dst`, atomically since workers of a batch merge into the
+/// same totals. The peak is the largest of the workers', since their arenas
+/// are separate.
+void timer_merge(timer_passes_t *t_dst, const timer_passes_t *t_src);
+
+/// Prints a table of the phases that ran to stderr, or JSON with `t_json`.
+void timer_print(const timer_passes_t *t_timers, bool t_json);
+/// Same as `timer_print()`, for the allocations of each phase.
+void timer_print_memory(const timer_passes_t *t_timers, bool t_json);
+
+#endif  // TIMER_H_INCLUDED
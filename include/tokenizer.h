@@ -1,9 +1,13 @@
 #ifndef TOKENIZER_H_INCLUDED
 #define TOKENIZER_H_INCLUDED
 
+#include <stdint.h>
+
 #include "defines.h"
 #include "libraries/rit_dyn_arr.h"
 #include "libraries/rit_str.h"
+#include "source.h"
+#include "symbols.h"
 
 typedef enum {
   token_ident,
@@ -21,6 +25,7 @@ typedef enum {
   token_colon,
   token_semicolon,
   token_newline,
+  token_eof,
   token_invalid,  // Used when parser tries to find a token of specific type but
                   // did not find it
 
@@ -29,32 +34,94 @@ typedef enum {
 } token_type;
 
 static const char *token_type_strs[] = {
-    "identifier", "exit", "number", "+", "-", "*",       "/",       "=",    "(",
-    ")",          "{",    "}",      ":", ";", "newline", "invalid", "error"};
+    "identifier", "exit", "number",  "+",           "-",       "*",
+    "/",          "=",    "(",       ")",           "{",       "}",
+    ":",          ";",    "newline", "end of file", "invalid", "error"};
+
+typedef rda_struct(uint8_t) token_kinds_t;
+typedef rda_struct(uint32_t) token_offsets_t;
+
+/// Tokens are stored as parallel arrays, the token at index `i` is
+/// `kinds[i]`, spanning `lens[i]` bytes from `offsets[i]` in the source
+/// buffer. Identifiers and keywords also carry their interned id in
+/// `syms[i]`, it is unused for other tokens. The stream always ends with a
+/// `token_eof`.
+typedef struct {
+  token_kinds_t kinds;
+  token_offsets_t offsets;
+  token_offsets_t lens;
+  token_offsets_t syms;
+} tokens_t;
 
 typedef struct {
   size_t line;
   size_t col;
-  rsv value;
-  token_type type;
-} token_t;
-
-typedef rda_struct(token_t) tokens_t;
+} token_loc_t;
 
 typedef struct {
   tokens_t tokens;
+  // Byte offset of every '\n' in the buffer, used to recover line and column
+  // numbers lazily, see `tokenizer_loc()`
+  token_offsets_t newlines;
+  // Byte offset of every byte that starts no token, reported once lexing is
+  // done so chunks lexed in parallel report them in order
+  token_offsets_t errors;
+  // Lines before the first entry of `newlines` and where the first of them
+  // starts, both 0 unless the buffer is lexed in batches
+  size_t line_base;
+  size_t line_base_offset;
   size_t idx;
-  size_t line;
-  size_t col;
-  struct rstr buffer;
+  rsv buffer;
+  source_t source;
+  symbols_t symbols;
   rstr_allocator *allocator;
 } tokenizer_t;
 
-#define tokenizer_create(t_tokenizer_name, t_file, t_allocator) \
-  tokenizer_t t_tokenizer_name = tokenizer_init(t_file, t_allocator)
-
-tokenizer_t tokenizer_init(const char *t_file, rstr_allocator *t_allocator);
+/// Opens `t_file` into `t_tokenizer`. Returns false, having reported why, if
+/// it cannot be read, `t_tokenizer` is then left untouched.
+bool tokenizer_init(tokenizer_t *t_tokenizer, const char *t_file,
+                    rstr_allocator *t_allocator);
+void tokenizer_deinit(tokenizer_t *t_tokenizer);
 void tokenize(tokenizer_t *t_tokenizer);
+/// Like `tokenize()`, but cuts the buffer into `t_jobs` chunks at newlines and
+/// lexes them on that many threads, each into arrays and a symbol table of its
+/// own. The chunks are then stitched together in order, interning their names
+/// into the tokenizer's symbol table, so the result is identical to
+/// `tokenize()`. Small buffers are lexed on the calling thread.
+void tokenize_parallel(tokenizer_t *t_tokenizer, size_t t_jobs);
+/// Empties the token, newline and error arrays, then lexes the next batch of
+/// about `t_batch_size` bytes into them, cut just past a newline so no
+/// statement spans two batches. Each batch ends with `token_eof`. Returns
+/// false once the end of the buffer has been reached. The caller keeps
+/// `line_base` and `line_base_offset` up to date between batches.
+bool tokenize_batch(tokenizer_t *t_tokenizer, size_t t_batch_size);
+token_loc_t tokenizer_loc(tokenizer_t *t_tokenizer, size_t t_offset);
+
+static inline size_t tokens_size(tokens_t *t_tokens) {
+  return rda_size(t_tokens->kinds);
+}
+
+static inline token_type tokenizer_token_type(tokenizer_t *t_tokenizer,
+                                              size_t t_idx) {
+  return (token_type)rda_at(t_tokenizer->tokens.kinds, t_idx);
+}
+
+static inline rsv tokenizer_token_value(tokenizer_t *t_tokenizer,
+                                        size_t t_idx) {
+  return (rsv){.m_str = rsv_get(t_tokenizer->buffer) +
+                        rda_at(t_tokenizer->tokens.offsets, t_idx),
+               .m_size = rda_at(t_tokenizer->tokens.lens, t_idx)};
+}
+
+static inline symbol_id tokenizer_token_symbol(tokenizer_t *t_tokenizer,
+                                               size_t t_idx) {
+  return rda_at(t_tokenizer->tokens.syms, t_idx);
+}
+
+static inline token_loc_t tokenizer_token_loc(tokenizer_t *t_tokenizer,
+                                              size_t t_idx) {
+  return tokenizer_loc(t_tokenizer, rda_at(t_tokenizer->tokens.offsets, t_idx));
+}
 
 static inline const char *token_type_to_str(token_type t_token_type) {
   return token_type_strs[t_token_type];
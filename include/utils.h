@@ -2,6 +2,8 @@
 #define UTILS_H_INCLUDED
 
 #include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,11 +39,61 @@ INTERNAL_DEF inline char *utils_shift_args_with_location(const char *file,
 
 static inline void utils_putd(int num) { printf("%d\n", num); }
 
-static inline struct rstr utils_read_file(const char *t_file,
-                                          rstr_allocator *t_allocator) {
-  FILE *fp = fopen(t_file, "r");
-  rstr_getstream(fp, stream_rstr, t_allocator);
-  return stream_rstr;
+/// Converts a run of decimal digits to an integer. Unlike `atoi()`, this does
+/// not need `t_sv` to be NUL-terminated.
+static inline int64_t utils_rsv_to_int64(rsv t_sv) {
+  int64_t ret = 0;
+  for (size_t i = 0; i < rsv_size(t_sv); ++i) {
+    ret = ret * 10 + (rsv_get(t_sv)[i] - '0');
+  }
+  return ret;
+}
+
+/// Parses `t_str`, the value of the `t_flag` option, as a count no smaller
+/// than `t_min`. Unlike `strtoul()` alone, anything but decimal digits is an
+/// error rather than a 0.
+static inline bool utils_parse_count(const char *t_flag, const char *t_str,
+                                     size_t t_min, size_t *t_out) {
+  char *end = nullptr;
+  errno = 0;
+  unsigned long long value = strtoull(t_str, &end, 10);
+  if (*t_str < '0' || *t_str > '9' || *end != '\0' || errno == ERANGE ||
+      value > SIZE_MAX) {
+    fprintf(stderr, "Error: %s expects a number, got `%s`\n", t_flag, t_str);
+    return false;
+  }
+  if (value < t_min) {
+    fprintf(stderr, "Error: %s must be at least %zu\n", t_flag, t_min);
+    return false;
+  }
+  *t_out = (size_t)value;
+  return true;
+}
+
+/// Reads everything left in `t_fp` into `t_out`. Used for inputs that cannot
+/// be memory-mapped, like pipes and stdin.
+static inline bool utils_read_stream(FILE *t_fp, struct rstr *t_out,
+                                     rstr_allocator *t_allocator) {
+  rstr_getstream(t_fp, stream_rstr, t_allocator);
+  if (ferror(t_fp)) {
+    fprintf(stderr, "Error: could not read stream: %s\n", strerror(errno));
+    return false;
+  }
+  *t_out = stream_rstr;
+  return true;
+}
+
+static inline bool utils_read_file(const char *t_file, struct rstr *t_out,
+                                   rstr_allocator *t_allocator) {
+  FILE *fp = fopen(t_file, "rb");
+  if (!fp) {
+    fprintf(stderr, "Error: could not open file `%s`: %s\n", t_file,
+            strerror(errno));
+    return false;
+  }
+  bool success = utils_read_stream(fp, t_out, t_allocator);
+  fclose(fp);
+  return success;
 }
 
 #endif  // UTILS_H_INCLUDED
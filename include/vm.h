@@ -0,0 +1,49 @@
+#ifndef VM_H_INCLUDED
+#define VM_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "defines.h"
+#include "libraries/rit_dyn_arr.h"
+#include "parser.h"
+#include "symbols.h"
+
+typedef enum {
+  vm_op_const,  // dst = consts[a]
+  vm_op_store,  // dst = (int32_t)a, variables are 32-bit like the C backend
+  vm_op_add,    // dst = a + b
+  vm_op_sub,    // dst = a - b
+  vm_op_mul,    // dst = a * b
+  vm_op_div,    // dst = a / b
+  vm_op_exit,   // Exit with a
+  vm_op_halt,   // Exit with 0, the end of the program
+} vm_opcode;
+
+/// Operands are register numbers, except for the constant index of
+/// `vm_op_const`.
+typedef struct {
+  uint32_t op;
+  uint32_t dst;
+  uint32_t a;
+  uint32_t b;
+} vm_instr;
+
+/// Register-based bytecode for a `node_prg`. Every variable has a register
+/// of its own, and temporaries are allocated above them in stack order, so
+/// nothing is ever copied to or from a separate operand stack.
+typedef struct {
+  rda_struct(vm_instr) code;
+  rda_struct(int64_t) consts;
+  uint32_t regs_len;
+} vm_program;
+
+/// Returns false if `t_prg` uses a variable before declaring it.
+bool vm_compile(vm_program *t_vm_prg, node_prg *t_prg, symbols_t *t_symbols,
+                rda_allocator *t_allocator);
+
+/// Runs the program and stores the status it exits with, as the generated C
+/// would pass it to `exit()`. Returns false if the program divides by zero.
+bool vm_run(vm_program *t_vm_prg, int *t_status, rda_allocator *t_allocator);
+
+#endif  // VM_H_INCLUDED
@@ -31,10 +31,82 @@ char *cc = "cl";
 #define nullptr (void *)0
 
 char *target = "build/thor";
+char *bench_target = "build/thor_bench";
+char *bench_src_file = "./bench/bench.c";
+/// Micro-benchmark counting what lexing allocates, run by `bench --lex`
+char *lex_bench_target = "build/thor_lex";
+char *lex_bench_src_file = "./bench/lex.c";
+bool bench_lex = false;
+char *test_target = "build/thor_test";
+char *test_src_file = "./tests/test.c";
 char *include_dir = "./include/";
+/// How many sources to compile at once, set by `-j`, 0 for one per core
+size_t jobs = 0;
+/// Where objects are kept by the hash of what they were compiled from
+char *cache_dir = "build/cache/";
+/// MB the cache is trimmed to after a build, set by `--cache-size`, 0 turns
+/// the cache off
+size_t cache_size = 256;
 
-char *src_files[] = {"./src/allocator.c", "./src/main.c", "./src/parser.c",
-                     "./src/tokenizer.c"};
+/// How the compiler is built, set by `--profile`.
+typedef enum {
+  profile_debug,    // `-DDEBUG -g`, which prints every token and statement
+  profile_release,  // Optimized
+  profile_lto,      // Optimized across translation units at link time
+  profile_pgo,      // Optimized with a profile of the training corpus
+  profiles_len,
+} profile_t;
+
+char *profile_names[profiles_len] = {
+    [profile_debug] = "debug",
+    [profile_release] = "release",
+    [profile_lto] = "lto",
+    [profile_pgo] = "pgo",
+};
+/// Where each profile's objects go, so switching profiles rebuilds nothing
+char *profile_obj_dirs[profiles_len] = {
+    [profile_debug] = "build/obj/",
+    [profile_release] = "build/obj-release/",
+    [profile_lto] = "build/obj-lto/",
+    [profile_pgo] = "build/obj-pgo/",
+};
+/// `profiles_len` until `--profile` is given, `com` and `run` then default to
+/// `profile_debug` and `bench` to `profile_release`. `bench --profile=all`
+/// leaves it at `profiles_len`.
+profile_t profile = profiles_len;
+bool profile_all = false;
+
+/// Whether to compile all sources as one translation unit, set by `--unity`
+bool unity = false;
+/// Whether `bench` compares a unity build with the normal one, set by
+/// `--unity=compare`
+bool unity_compare = false;
+/// Whether to compile every source even if its object is up to date, set by
+/// `--rebuild`
+bool rebuild = false;
+
+/// Instrumented compiler that runs the training corpus for `profile_pgo`
+char *pgo_target = "build/thor_train";
+/// Its objects, apart from the optimized ones in `profile_obj_dirs` so
+/// neither build makes the other out of date
+char *pgo_obj_dir = "build/obj-pgo-train/";
+/// Hash of the profile the objects being compiled are optimized with, 0 if
+/// none. It is part of their flags, so a new profile rebuilds them.
+uint64_t pgo_profile = 0;
+char *pgo_dir = "build/pgo/";
+char *pgo_train_dir = "build/pgo/train/";
+/// Sources the profile is trained on, copied to `pgo_train_dir` first since
+/// the C is written next to them
+char *pgo_corpus_dir = "examples/training/";
+
+char *src_files[] = {"./src/allocator.c", "./src/cache.c",
+                     "./src/compiler.c", "./src/jit.c",
+                     "./src/main.c", "./src/optimizer.c",
+                     "./src/parser.c", "./src/pipeline.c",
+                     "./src/scanner.c", "./src/source.c",
+                     "./src/stream.c", "./src/symbols.c",
+                     "./src/timer.c", "./src/tokenizer.c",
+                     "./src/vm.c"};
 const size_t SRC_FILES_LEN = sizeof(src_files) / sizeof(char *);
 
 void *arena_allocator_alloc(void *t_arena, size_t t_size_in_bytes) {
@@ -60,49 +132,669 @@ void help_msg(const char *subcmd, const char *utils_prg_name) {
     printf("subcommands:\n");
     printf("    com     Compile %s\n", target);
     printf("    run     Compile and run %s\n", target);
+    printf("    bench   Compile and run the benchmark, %s\n", bench_target);
+    printf("    test    Compile and run the tests, %s\n", test_target);
     printf("    help    Print help information for command and subcommands\n");
   } else if (!strcmp(subcmd, "com")) {
-    printf("No help information avalaible for the \"com\" subcommand\n");
+    printf("Usage: %s com [--profile=debug|release|lto|pgo] [--unity] "
+           "[--rebuild] [-j jobs]\n"
+           "       [--cache-size=MB|--no-cache]\n",
+           utils_prg_name);
+    printf("Compiles each source to an object in build/obj/, or "
+           "build/obj-<profile>/,\nskipping those whose source and headers "
+           "did not change, and links them\n");
+    printf("args:\n");
+    printf("    --profile=debug    Print every token and statement, the "
+           "default\n");
+    printf("    --profile=release  Optimize\n");
+    printf("    --profile=lto      Optimize across sources when linking\n");
+    printf("    --profile=pgo      Optimize for how %s compiles "
+           "%s,\n"
+           "                       building it twice\n",
+           target, pgo_corpus_dir);
+    printf("    --unity    Compile all sources as one translation unit, so "
+           "calls between\n"
+           "               them can be inlined, not with the pgo profile\n");
+    printf("    --rebuild  Compile every source, even if it did not change\n");
+    printf("    -j      How many sources to compile at once, defaults to the "
+           "number of cores\n");
+    printf("    --cache-size  Keep objects in %s by the hash of their "
+           "preprocessed\n"
+           "                  source, flags and compiler, evicting the least "
+           "recently used\n"
+           "                  past this many MB, defaults to 256\n",
+           cache_dir);
+    printf("    --no-cache    Always compile the sources that changed\n");
   } else if (!strcmp(subcmd, "run")) {
-    printf("Usage: %s run -- [args]\n", utils_prg_name);
+    printf("Usage: %s run [com args] -- [args]\n", utils_prg_name);
     printf("args:\n");
     printf(
         "   The arguments that need to be passed as command line arguments to "
         "%s",
         target);
+  } else if (!strcmp(subcmd, "bench")) {
+    printf("Usage: %s bench [com args] [--profile=all|--unity=compare|--lex] "
+           "-- [args]\n",
+           utils_prg_name);
+    printf("Builds %s with the release profile, unless `--profile` says "
+           "otherwise,\nand runs it\n",
+           bench_target);
+    printf("args:\n");
+    printf("    --profile=all  Run it with the release, lto and pgo profiles "
+           "and compare\n"
+           "                   their throughput\n");
+    printf("    --unity=compare  Build it from scratch as separate sources and "
+           "as a unity\n"
+           "                     build, and compare build time and "
+           "throughput\n");
+    printf("    --lex   Run %s instead, which counts the allocations "
+           "lexing makes\n",
+           lex_bench_target);
+    printf(
+        "   The arguments after `--` are passed to %s, `-- --help` lists "
+        "them",
+        bench_target);
+  } else if (!strcmp(subcmd, "test")) {
+    printf("Usage: %s test [com args] -- [args]\n", utils_prg_name);
+    printf("Builds %s with the release profile, unless `--profile` says "
+           "otherwise,\nand runs every test program on every backend, "
+           "building the generated code\nwith %s\n",
+           test_target, cc);
+    printf(
+        "   The arguments after `--` are passed to %s, `-- --help` lists "
+        "them",
+        test_target);
   } else {
     fprintf(stderr, "Error: unknown subcommand %s", subcmd);
   }
 }
 
-void com_prg() {
-  if (!make_dir("build/")) {
+/// Prints `t_cmd` after `t_what`, as it is about to run.
+void print_cmd(const char *t_what, cmd_t *t_cmd) {
+  printf("[INFO] %s...\n[INFO] cmd: ", t_what);
+  rda_for_each(it, (*t_cmd)) { printf("%s ", *it); }
+  putchar('\n');
+  // Before the command's own output
+  fflush(stdout);
+}
+
+/// A source that has to be compiled again.
+typedef struct {
+  char *src;
+  char *obj;
+  char dep[256];     // Depfile written by `-MMD`
+  char pre[256];     // Preprocessed source, hashed to look the object up
+  char cached[256];  // Where the object is kept in the cache
+  bool hit;
+} com_unit;
+
+/// Removes the least recently used objects from the cache until it fits in
+/// `cache_size`. Hits touch the object they restore, so the oldest
+/// modification time is the least recently used.
+void cache_evict(const char *t_obj_ext) {
+  file_infos_t files = {};
+  rda_init(files, 0, sizeof(file_info_t), &allocator);
+  files.m_size = 0;
+  if (!list_files(cache_dir, t_obj_ext, &files, &allocator)) return;
+  size_t evicted = evict_files(&files, (uint64_t)cache_size * 1024 * 1024);
+  if (evicted > 0) {
+    printf("[INFO] Cache: evicted %zu objects to stay under %zu MB\n",
+           evicted, cache_size);
+  }
+}
+
+/// Adds `t_hits` and `t_misses` to the totals kept in the cache, and prints
+/// both.
+void cache_stats(size_t t_hits, size_t t_misses) {
+  char stats[256];
+  snprintf(stats, sizeof(stats), "%sstats", cache_dir);
+  unsigned long long hits = 0;
+  unsigned long long misses = 0;
+  FILE *file = fopen(stats, "rb");
+  if (file) {
+    if (fscanf(file, "%llu %llu", &hits, &misses) != 2) hits = misses = 0;
+    fclose(file);
+  }
+  hits += t_hits;
+  misses += t_misses;
+  file = fopen(stats, "wb");
+  if (file) {
+    fprintf(file, "%llu %llu\n", hits, misses);
+    fclose(file);
+  }
+  printf("[INFO] Cache: %zu hits, %zu misses, %llu hits and %llu misses in "
+         "total\n",
+         t_hits, t_misses, hits, misses);
+}
+
+/// Compiles each of `t_srcs` to an object in `t_obj_dir`, `jobs` of them at
+/// a time, and links the objects into `t_target`. An object that is newer
+/// than its source and the headers it includes, and was built with the same
+/// `t_cflags`, is not compiled again.
+///
+/// Before compiling, the source is preprocessed and hashed together with the
+/// compiler's version and `t_cflags`. An object cached under that hash is
+/// copied over instead, and compiled objects are cached.
+void com_target(const char *t_target, const char *t_obj_dir, cmd_t *t_cflags,
+                cmd_t *t_ldflags, char **t_srcs, size_t t_srcs_len) {
+  bool msvc = !strcmp(cc, "cl");
+  const char *obj_ext = msvc ? ".obj" : ".o";
+  // Objects built with other flags are all out of date
+  char flags[1024];
+  size_t flags_len = snprintf(flags, sizeof(flags), "%s", cc);
+  rda_for_each(it, (*t_cflags)) {
+    if (flags_len >= sizeof(flags)) break;
+    flags_len += snprintf(flags + flags_len, sizeof(flags) - flags_len, " %s",
+                          *it);
+  }
+  if (pgo_profile && flags_len < sizeof(flags)) {
+    snprintf(flags + flags_len, sizeof(flags) - flags_len, " profile=%016llx",
+             (unsigned long long)pgo_profile);
+  }
+  char stamp[256];
+  snprintf(stamp, sizeof(stamp), "%sflags", t_obj_dir);
+  bool flags_same = file_equals_str(stamp, flags);
+
+  cmd(link_cmd, &allocator);
+  cmd_push_back(link_cmd, cc, &allocator);
+  int64_t target_mtime = 0;
+  char target_file[BIN_NAME_MAX_SZ + 8];
+  sprintf(target_file, msvc ? "%s.exe" : "%s", t_target);
+  bool relink = !file_mtime(target_file, &target_mtime);
+  com_unit *units = malloc(t_srcs_len * sizeof(com_unit));
+  size_t units_len = 0;
+  for (size_t i = 0; i < t_srcs_len; ++i) {
+    // `./src/main.c` compiles to `build/obj/main.o`
+    const char *name = strrchr(t_srcs[i], '/');
+    name = name ? name + 1 : t_srcs[i];
+    int name_len = (int)(strlen(name) - strlen(".c"));
+    char *obj = arena_alloc(&arena, 256);
+    snprintf(obj, 256, "%s%.*s%s", t_obj_dir, name_len, name, obj_ext);
+    cmd_push_back(link_cmd, obj, &allocator);
+    com_unit *unit = &units[units_len];
+    unit->src = t_srcs[i];
+    unit->obj = obj;
+    unit->hit = false;
+    unit->cached[0] = '\0';
+    snprintf(unit->dep, sizeof(unit->dep), "%s%.*s.d", t_obj_dir, name_len,
+             name);
+    snprintf(unit->pre, sizeof(unit->pre), "%s%.*s.i", t_obj_dir, name_len,
+             name);
+    if (!rebuild && flags_same && depfile_up_to_date(obj, unit->dep)) {
+      int64_t obj_mtime;
+      if (file_mtime(obj, &obj_mtime) && obj_mtime > target_mtime) {
+        relink = true;
+      }
+      continue;
+    }
+    relink = true;
+    ++units_len;
+  }
+
+  size_t max_jobs = jobs > 0 ? jobs : cpu_count();
+  cmd_t *cmds = malloc(units_len * sizeof(cmd_t));
+  size_t hits = 0;
+  bool use_cache = cache_size > 0 && units_len > 0;
+  uint64_t base_hash = hash_bytes(HASH_FNV_OFFSET, flags, strlen(flags));
+  if (use_cache) {
+    // The compiler that builds the objects, `cl` prints its version banner
+    // to stderr when run without arguments
+    char version_cmd[256];
+    snprintf(version_cmd, sizeof(version_cmd),
+             msvc ? "%s 2>&1" : "%s --version", cc);
+    if (!hash_cmd_output(&base_hash, version_cmd)) {
+      printf("[INFO] Cache: `%s` printed nothing, building without the "
+             "cache\n", version_cmd);
+      use_cache = false;
+    }
+  }
+  if (use_cache) {
+    if (!make_dir(cache_dir)) exit(1);
+    for (size_t i = 0; i < units_len; ++i) {
+      com_unit *unit = &units[i];
+      cmd_init(cmds[i], 0, &allocator);
+      cmds[i].m_size = 0;
+      cmd_push_back(cmds[i], cc, &allocator);
+      cmd_append_cmd(cmds[i], (*t_cflags), &allocator);
+      if (msvc) {
+        char *outflag = arena_alloc(&arena, sizeof(unit->pre) + 4);
+        sprintf(outflag, "-Fi%s", unit->pre);
+        cmd_append(cmds[i], &allocator, "-P", outflag, unit->src);
+      } else {
+        // The depfile is written here too, in case the object is a hit
+        cmd_append(cmds[i], &allocator, "-E", unit->src, "-o", unit->pre,
+                   "-MMD", "-MP", "-MF", unit->dep, "-MT", unit->obj);
+      }
+      cmd_append(cmds[i], &allocator, "-I", include_dir);
+      print_cmd("Preprocessing source code", &cmds[i]);
+    }
+    if (!cmd_run_parallel(cmds, units_len, max_jobs)) {
+      fprintf(stderr, "Error: could not preprocess `%s`\n", t_target);
+      exit(1);
+    }
+    for (size_t i = 0; i < units_len; ++i) {
+      com_unit *unit = &units[i];
+      uint64_t hash = base_hash;
+      bool hashed = hash_file(&hash, unit->pre);
+      remove(unit->pre);
+      if (!hashed) continue;
+      snprintf(unit->cached, sizeof(unit->cached), "%s%016llx%s", cache_dir,
+               (unsigned long long)hash, obj_ext);
+      unit->hit = file_touch(unit->cached) &&
+                  file_copy(unit->cached, unit->obj);
+      if (unit->hit) {
+        printf("[INFO] Restored `%s` from the cache\n", unit->obj);
+        ++hits;
+      }
+    }
+  }
+
+  size_t misses = 0;
+  for (size_t i = 0; i < units_len; ++i) {
+    com_unit *unit = &units[i];
+    if (unit->hit) continue;
+    cmd_t *compile_cmd = &cmds[misses++];
+    cmd_init(*compile_cmd, 0, &allocator);
+    compile_cmd->m_size = 0;
+    cmd_push_back(*compile_cmd, cc, &allocator);
+    cmd_append_cmd(*compile_cmd, (*t_cflags), &allocator);
+    if (msvc) {
+      char *outflag = arena_alloc(&arena, 256 + 4);
+      sprintf(outflag, "-Fo%s", unit->obj);
+      cmd_append(*compile_cmd, &allocator, "-c", unit->src, outflag);
+    } else {
+      cmd_append(*compile_cmd, &allocator, "-MMD", "-MP", "-c", unit->src,
+                 "-o", unit->obj);
+    }
+    cmd_append(*compile_cmd, &allocator, "-I", include_dir);
+    print_cmd("Compiling source code", compile_cmd);
+  }
+  if (!cmd_run_parallel(cmds, misses, max_jobs)) {
+    fprintf(stderr, "Error: could not compile `%s`\n", t_target);
+    exit(1);
+  }
+  file_write_str(stamp, flags);
+  if (use_cache) {
+    for (size_t i = 0; i < units_len; ++i) {
+      if (!units[i].hit && units[i].cached[0] != '\0') {
+        file_copy(units[i].obj, units[i].cached);
+      }
+    }
+    cache_stats(hits, misses);
+    cache_evict(obj_ext);
+  }
+  free(cmds);
+  free(units);
+
+  if (msvc) {
+    char *outflag = arena_alloc(&arena, BIN_NAME_MAX_SZ + 8);
+    sprintf(outflag, "-Fe%s.exe", t_target);
+    cmd_append(link_cmd, &allocator, "-nologo", outflag);
+  } else {
+    cmd_append(link_cmd, &allocator, "-o", (char *)t_target);
+  }
+  cmd_append_cmd(link_cmd, (*t_ldflags), &allocator);
+  // A target linked from another profile's objects is relinked too
+  char link[2048];
+  size_t link_len = 0;
+  link[0] = '\0';
+  rda_for_each(it, link_cmd) {
+    if (link_len >= sizeof(link)) break;
+    link_len += snprintf(link + link_len, sizeof(link) - link_len, "%s ", *it);
+  }
+  char link_stamp[BIN_NAME_MAX_SZ + 8];
+  snprintf(link_stamp, sizeof(link_stamp), "%s.link", t_target);
+  if (!relink && file_equals_str(link_stamp, link)) {
+    printf("[INFO] `%s` is up to date\n", t_target);
+    return;
+  }
+  print_cmd("Linking", &link_cmd);
+  if (!cmd_run_sync(link_cmd)) {
+    fprintf(stderr, "Error: cmd_run_sync() failed, file: %s, line: %d\n",
+            __FILE__, __LINE__);
+    exit(1);
+  }
+  file_write_str(link_stamp, link);
+}
+
+/// Sets the flags `t_profile` compiles and links with. With `t_train`, the
+/// objects are instrumented to write the profile `profile_pgo` is optimized
+/// with, otherwise `profile_pgo` reads it.
+void profile_flags(profile_t t_profile, bool t_train, cmd_t *t_cflags,
+                   cmd_t *t_ldflags) {
+  bool msvc = !strcmp(cc, "cl");
+  if (msvc) {
+    cmd_append(*t_cflags, &allocator, "-EHsc", "-nologo", "-W4",
+               "-D_CRT_SECURE_NO_WARNINGS");
+  } else {
+    cmd_append(*t_cflags, &allocator, "-Wall", "-Wextra",
+               "-Wno-unknown-pragmas", "-pthread");
+    cmd_append(*t_ldflags, &allocator, "-pthread");
+  }
+  switch (t_profile) {
+    case profile_debug: {
+      if (msvc) {
+        cmd_append(*t_cflags, &allocator, "-Zi", "-MTd",
+                   "-DDEBUG" /* , "-fsanitize=address" */);
+      } else {
+        cmd_append(*t_cflags, &allocator, "-DDEBUG",
+                   "-g" /* , "-fsanitize=address" */);
+      }
+      break;
+    }
+    case profile_release: {
+      cmd_append(*t_cflags, &allocator, "-O2");
+      if (msvc) cmd_append(*t_cflags, &allocator, "-MT");
+      break;
+    }
+    case profile_lto: {
+      if (msvc) {
+        cmd_append(*t_cflags, &allocator, "-O2", "-MT", "-GL");
+        cmd_append(*t_ldflags, &allocator, "-link", "-LTCG");
+      } else {
+        cmd_append(*t_cflags, &allocator, "-O2", "-flto");
+        cmd_append(*t_ldflags, &allocator, "-O2", "-flto");
+      }
+      break;
+    }
+    case profile_pgo: {
+      cmd_append(*t_cflags, &allocator, "-O2");
+      char *flag = arena_alloc(&arena, 64);
+      if (t_train) {
+        sprintf(flag, "-fprofile-generate=%s", pgo_dir);
+        cmd_append(*t_ldflags, &allocator, flag);
+        // gcc names each object's profile after the object, so the
+        // instrumented ones are named as if they were the optimized ones
+        if (strcmp(cc, "clang")) {
+          cmd_append(*t_cflags, &allocator, "-dumpdir",
+                     profile_obj_dirs[profile_pgo]);
+        }
+      } else if (!strcmp(cc, "clang")) {
+        sprintf(flag, "-fprofile-use=%sthor.profdata", pgo_dir);
+      } else {
+        sprintf(flag, "-fprofile-use=%s", pgo_dir);
+        // Like the benchmark's driver, which the training does not run
+        cmd_append(*t_cflags, &allocator, "-Wno-missing-profile");
+      }
+      cmd_append(*t_cflags, &allocator, flag);
+      break;
+    }
+    default: {
+      assert(0 && "unreachable");
+    }
+  }
+}
+
+/// @internal
+int file_info_compare_path(const void *t_lhs, const void *t_rhs) {
+  return strcmp(((const file_info_t *)t_lhs)->path,
+                ((const file_info_t *)t_rhs)->path);
+}
+
+/// @internal
+/// Folds the names and contents of the files in `t_dir` ending in `t_ext`
+/// into `t_hash`, in the order of their names. Returns how many there are.
+size_t hash_files(uint64_t *t_hash, const char *t_dir, const char *t_ext) {
+  file_infos_t files = {};
+  rda_init(files, 0, sizeof(file_info_t), &allocator);
+  files.m_size = 0;
+  list_files(t_dir, t_ext, &files, &allocator);
+  qsort(rda_data(files), rda_size(files), sizeof(file_info_t),
+        file_info_compare_path);
+  rda_for_each(it, files) {
+    *t_hash = hash_bytes(*t_hash, it->path, strlen(it->path) + 1);
+    if (!hash_file(t_hash, it->path)) {
+      fprintf(stderr, "Error: could not read `%s`\n", it->path);
+      exit(1);
+    }
+  }
+  return rda_size(files);
+}
+
+/// Builds the compiler instrumented, and compiles the training corpus with it
+/// to write the profile `profile_pgo` is optimized with. The training is
+/// skipped if neither the instrumented compiler nor the corpus changed since
+/// the profile was written. Returns a hash of the profile, which the objects
+/// optimized with it depend on.
+uint64_t pgo_train() {
+  if (!strcmp(cc, "cl")) {
+    fprintf(stderr, "Error: the pgo profile needs gcc or clang\n");
+    exit(1);
+  }
+  if (!make_dir(pgo_dir) || !make_dir(pgo_train_dir) ||
+      !make_dir(pgo_obj_dir)) {
+    exit(1);
+  }
+  bool clang = !strcmp(cc, "clang");
+  cmd(cflags, &allocator);
+  cmd(ldflags, &allocator);
+  profile_flags(profile_pgo, true, &cflags, &ldflags);
+  com_target(pgo_target, pgo_obj_dir, &cflags, &ldflags, src_files,
+             SRC_FILES_LEN);
+
+  char *train_args[][2] = {{"-O1", "--backend=c"},
+                           {"-O0", "--backend=c"},
+                           {"-O1", "--backend=asm"}};
+  size_t train_args_len = sizeof(train_args) / sizeof(train_args[0]);
+  uint64_t inputs = HASH_FNV_OFFSET;
+  for (size_t i = 0; i < train_args_len; ++i) {
+    inputs = hash_bytes(inputs, train_args[i][0], strlen(train_args[i][0]));
+    inputs = hash_bytes(inputs, train_args[i][1], strlen(train_args[i][1]));
+  }
+  if (!hash_file(&inputs, pgo_target)) {
+    fprintf(stderr, "Error: could not read `%s`\n", pgo_target);
+    exit(1);
+  }
+  hash_files(&inputs, pgo_corpus_dir, ".th");
+  char stamp[64];
+  snprintf(stamp, sizeof(stamp), "%016llx", (unsigned long long)inputs);
+  char stamp_file[256];
+  snprintf(stamp_file, sizeof(stamp_file), "%strained", pgo_dir);
+  const char *profile_ext = clang ? ".profdata" : ".gcda";
+  uint64_t profile_hash = HASH_FNV_OFFSET;
+  if (file_equals_str(stamp_file, stamp) &&
+      hash_files(&profile_hash, pgo_dir, profile_ext) > 0) {
+    printf("[INFO] The profile in `%s` is up to date\n", pgo_dir);
+    return profile_hash;
+  }
+  // A profile that is not finished must not look trained
+  remove(stamp_file);
+
+  // Counters from an earlier training would add up with these
+  file_infos_t files = {};
+  rda_init(files, 0, sizeof(file_info_t), &allocator);
+  files.m_size = 0;
+  list_files(pgo_dir, clang ? ".profraw" : ".gcda", &files, &allocator);
+  rda_for_each(it, files) { remove(it->path); }
+
+  files.m_size = 0;
+  if (!list_files(pgo_corpus_dir, ".th", &files, &allocator)) {
+    fprintf(stderr, "Error: could not open directory `%s`\n", pgo_corpus_dir);
     exit(1);
   }
+  rda_for_each(it, files) {
+    char dst[256];
+    snprintf(dst, sizeof(dst), "%s%s", pgo_train_dir,
+             it->path + strlen(pgo_corpus_dir));
+    if (!file_copy(it->path, dst)) {
+      fprintf(stderr, "Error: could not copy `%s` to `%s`\n", it->path, dst);
+      exit(1);
+    }
+  }
+  char train_exe[BIN_NAME_MAX_SZ + 8];
+  sprintf(train_exe, "./%s", pgo_target);
+  for (size_t i = 0; i < train_args_len; ++i) {
+    cmd(train_cmd, &allocator);
+    cmd_append(train_cmd, &allocator, train_exe, "com", train_args[i][0],
+               train_args[i][1], pgo_train_dir);
+    print_cmd("Training", &train_cmd);
+    if (!cmd_run_sync(train_cmd)) {
+      fprintf(stderr, "Error: cmd_run_sync() failed, file: %s, line: %d\n",
+              __FILE__, __LINE__);
+      exit(1);
+    }
+  }
+
+  if (clang) {
+    files.m_size = 0;
+    list_files(pgo_dir, ".profraw", &files, &allocator);
+    char *out = arena_alloc(&arena, 64);
+    sprintf(out, "-output=%sthor.profdata", pgo_dir);
+    cmd(merge_cmd, &allocator);
+    cmd_append(merge_cmd, &allocator, "llvm-profdata", "merge", out);
+    rda_for_each(it, files) { cmd_push_back(merge_cmd, it->path, &allocator); }
+    print_cmd("Merging the profile", &merge_cmd);
+    if (!cmd_run_sync(merge_cmd)) {
+      fprintf(stderr, "Error: cmd_run_sync() failed, file: %s, line: %d\n",
+              __FILE__, __LINE__);
+      exit(1);
+    }
+  }
+  hash_files(&profile_hash, pgo_dir, profile_ext);
+  file_write_str(stamp_file, stamp);
+  return profile_hash;
+}
+
+/// Writes `t_file`, a translation unit including every one of `t_srcs`,
+/// unless it already is, so it only looks modified when the list changes.
+/// `t_file` is in `build/`.
+void write_unity(const char *t_file, char **t_srcs, size_t t_srcs_len) {
+  char unity_src[4096];
+  size_t len = snprintf(unity_src, sizeof(unity_src),
+                        "// Generated by `ribs --unity`, do not edit\n");
+  for (size_t i = 0; i < t_srcs_len && len < sizeof(unity_src); ++i) {
+    const char *src = t_srcs[i];
+    if (!strncmp(src, "./", 2)) src += 2;
+    len += snprintf(unity_src + len, sizeof(unity_src) - len,
+                    "#include \"../%s\"\n", src);
+  }
+  if (file_equals_str(t_file, unity_src)) return;
+  printf("[INFO] Writing `%s`\n", t_file);
+  file_write_str(t_file, unity_src);
+}
+
+/// Compiles `t_srcs` into `t_target` with `t_profile`, training the profile
+/// first for `profile_pgo`. With `unity`, they are compiled as a single
+/// translation unit, so the compiler can inline across them.
+void com_profile(profile_t t_profile, const char *t_target, char **t_srcs,
+                 size_t t_srcs_len) {
+  if (!make_dir("build/") || !make_dir(profile_obj_dirs[t_profile])) {
+    exit(1);
+  }
+  if (t_profile == profile_pgo) {
+    // The training compiler is not a unity build, so the profile would not
+    // match its objects
+    if (unity) {
+      fprintf(stderr, "Error: --unity cannot be used with the pgo profile\n");
+      exit(1);
+    }
+    // The profile's hash goes into the flags the objects are stamped and
+    // cached with, so they are rebuilt when it changes
+    pgo_profile = pgo_train();
+  }
   cmd(cflags, &allocator);
-  if (!strcmp(cc, "clang") || !strcmp(cc, "gcc")) {
-    cmd_append(cflags, &allocator, "-DDEBUG", "-g", "-Wall", "-Wextra",
-               "-Wno-unknown-pragmas", /* "-fsanitize=address",  */ "-o",
-               target);
+  cmd(ldflags, &allocator);
+  profile_flags(t_profile, false, &cflags, &ldflags);
+  if (unity) {
+    // `build/thor` compiles from `build/thor-release-unity.c`
+    char *unity_file = arena_alloc(&arena, 64);
+    sprintf(unity_file, "build/%s-%s-unity.c", t_target + strlen("build/"),
+            profile_names[t_profile]);
+    write_unity(unity_file, t_srcs, t_srcs_len);
+    com_target(t_target, profile_obj_dirs[t_profile], &cflags, &ldflags,
+               &unity_file, 1);
   } else {
-    char outflag[BIN_NAME_MAX_SZ + 8];
-    sprintf(outflag, "-Fe%s.exe", target);
-    cmd_append(cflags, &allocator, "-EHsc", "-nologo", "-W4", "-Zi", "-MTd",
-               "-D_CRT_SECURE_NO_WARNINGS",
-               "-DDEBUG", /* "-fsanitize=address", */
-               outflag);
-  }
-  cmd(build_cmd, &allocator);
-  cmd_push_back(build_cmd, cc, &allocator);
-  cmd_append_cmd(build_cmd, cflags, &allocator);
+    com_target(t_target, profile_obj_dirs[t_profile], &cflags, &ldflags,
+               t_srcs, t_srcs_len);
+  }
+  pgo_profile = 0;
+}
+
+void com_prg() {
+  com_profile(profile == profiles_len ? profile_debug : profile, target,
+              src_files, SRC_FILES_LEN);
+}
+
+/// Compiles the compiler without `main.c`, plus the driver `t_driver` of a
+/// benchmark or the tests, into `t_target` with `t_profile`.
+void com_driver(profile_t t_profile, const char *t_target, char *t_driver) {
+  char *srcs[SRC_FILES_LEN];
+  size_t srcs_len = 0;
   for (size_t i = 0; i < SRC_FILES_LEN; ++i) {
-    cmd_push_back(build_cmd, src_files[i], &allocator);
+    if (strcmp(src_files[i], "./src/main.c")) srcs[srcs_len++] = src_files[i];
   }
-  printf("[INFO] Compiling source code...\n[INFO] cmd: ");
-  cmd_append(build_cmd, &allocator, "-I", include_dir);
-  rda_for_each(it, build_cmd) { printf("%s ", *it); }
-  putchar('\n');
-  bool proc = cmd_run_sync(build_cmd);
+  srcs[srcs_len++] = t_driver;
+  com_profile(t_profile, t_target, srcs, srcs_len);
+}
+
+/// Shifts the arguments `ribs` itself takes, up to and including `--`.
+void parse_build_args(int *argc, char ***argv) {
+  while (*argc > 0) {
+    char *arg = utils_shift_args(argc, argv);
+    if (!strcmp(arg, "--")) break;
+    if (!strcmp(arg, "-j")) {
+      if (!utils_parse_count("-j", utils_shift_args(argc, argv), 1, &jobs)) {
+        exit(1);
+      }
+    } else if (!strncmp(arg, "--cache-size=", strlen("--cache-size="))) {
+      // 0 turns the cache off, like `--no-cache`
+      if (!utils_parse_count("--cache-size", arg + strlen("--cache-size="), 0,
+                             &cache_size)) {
+        exit(1);
+      }
+    } else if (!strcmp(arg, "--no-cache")) {
+      cache_size = 0;
+    } else if (!strcmp(arg, "--unity")) {
+      unity = true;
+    } else if (!strcmp(arg, "--unity=compare")) {
+      unity_compare = true;
+    } else if (!strcmp(arg, "--lex")) {
+      bench_lex = true;
+    } else if (!strcmp(arg, "--rebuild")) {
+      rebuild = true;
+    } else if (!strncmp(arg, "--profile=", strlen("--profile="))) {
+      const char *name = arg + strlen("--profile=");
+      profile = 0;
+      while (profile < profiles_len && strcmp(name, profile_names[profile])) {
+        ++profile;
+      }
+      profile_all = !strcmp(name, "all");
+      if (profile == profiles_len && !profile_all) {
+        fprintf(stderr, "Error: unknown profile %s\n", name);
+        exit(1);
+      }
+    } else {
+      fprintf(stderr, "Error: unknown argument %s\n", arg);
+      exit(1);
+    }
+  }
+}
+
+/// Builds the benchmark with `t_profile` and runs it with `t_args`, the
+/// results going to `t_out_file` under `t_label` unless it is `nullptr`.
+void run_bench(profile_t t_profile, cmd_t *t_args, const char *t_label,
+               char *t_out_file) {
+  const char *run_target = bench_lex ? lex_bench_target : bench_target;
+  com_driver(t_profile, run_target,
+             bench_lex ? lex_bench_src_file : bench_src_file);
+  // Where the benchmarks generate their sources
+  if (!make_dir("build/bench/")) exit(1);
+  cmd(run_cmd, &allocator);
+  char run_exe[BIN_NAME_MAX_SZ + 8];
+#if defined(BUILD_WINDOWS)
+  sprintf(run_exe, "%s.exe", run_target);
+#else
+  sprintf(run_exe, "./%s", run_target);
+#endif
+  cmd_append(run_cmd, &allocator, run_exe);
+  cmd_append_cmd(run_cmd, (*t_args), &allocator);
+  if (t_out_file) {
+    char *label = arena_alloc(&arena, 64);
+    sprintf(label, "--label=%s", t_label);
+    cmd_append(run_cmd, &allocator, label, "-o", t_out_file);
+  }
+  print_cmd("Running benchmark", &run_cmd);
+  bool proc = cmd_run_sync(run_cmd);
   if (!proc) {
     fprintf(stderr, "Error: cmd_run_sync() failed, file: %s, line: %d\n",
             __FILE__, __LINE__);
@@ -110,6 +802,148 @@ void com_prg() {
   }
 }
 
+#define BENCH_REPORT_ROWS 64
+#define BENCH_REPORT_COLS 4
+
+/// Median throughput of a phase on a corpus, for each build compared.
+typedef struct {
+  char corpus[32];
+  char phase[32];
+  double mb_s[BENCH_REPORT_COLS];
+} bench_report_row;
+
+/// Prints the median MB/s of every phase on every corpus, from the results
+/// the benchmark wrote to `t_files` for each build in `t_labels`.
+void bench_report(const char **t_labels, char **t_files, size_t t_len) {
+  bench_report_row rows[BENCH_REPORT_ROWS];
+  size_t rows_len = 0;
+  for (size_t i = 0; i < t_len; ++i) {
+    FILE *file = fopen(t_files[i], "rb");
+    if (!file) {
+      fprintf(stderr, "Error: could not open file `%s`\n", t_files[i]);
+      exit(1);
+    }
+    // The benchmark writes a corpus or a phase per line
+    char line[512];
+    char corpus[32] = "";
+    while (fgets(line, sizeof(line), file)) {
+      char phase[32];
+      double mb_s;
+      if (sscanf(line, " {\"name\": \"%31[^\"]\"", corpus) == 1) continue;
+      if (sscanf(line,
+                 " {\"phase\": \"%31[^\"]\", \"median_ns\": %*[0-9], "
+                 "\"p99_ns\": %*[0-9], \"median_mb_s\": %lf",
+                 phase, &mb_s) != 2) {
+        continue;
+      }
+      size_t row = 0;
+      while (row < rows_len && (strcmp(rows[row].corpus, corpus) ||
+                                strcmp(rows[row].phase, phase))) {
+        ++row;
+      }
+      if (row == rows_len) {
+        if (rows_len == BENCH_REPORT_ROWS) continue;
+        memset(&rows[row], 0, sizeof(bench_report_row));
+        strcpy(rows[row].corpus, corpus);
+        strcpy(rows[row].phase, phase);
+        ++rows_len;
+      }
+      rows[row].mb_s[i] = mb_s;
+    }
+    fclose(file);
+  }
+
+  printf("\nMedian MB/s, relative to %s:\n%-10s %-10s", t_labels[0],
+         "corpus", "phase");
+  for (size_t i = 0; i < t_len; ++i) printf(" %18s", t_labels[i]);
+  putchar('\n');
+  for (size_t row = 0; row < rows_len; ++row) {
+    printf("%-10s %-10s", rows[row].corpus, rows[row].phase);
+    double base = rows[row].mb_s[0];
+    for (size_t i = 0; i < t_len; ++i) {
+      double mb_s = rows[row].mb_s[i];
+      printf(" %10.2f (%4.2fx)", mb_s, base > 0 ? mb_s / base : 0);
+    }
+    putchar('\n');
+  }
+}
+
+void com_and_run_bench(int *argc, char ***argv) {
+  cmd(args, &allocator);
+  while (*argc > 0) {
+    char *arg = utils_shift_args(argc, argv);
+    cmd_append(args, &allocator, arg);
+  }
+  profile_t bench_profile = profile == profiles_len ? profile_release : profile;
+  if (bench_lex && (unity_compare || profile_all)) {
+    fprintf(stderr, "Error: --lex runs with a single build\n");
+    exit(1);
+  }
+  if (unity_compare) {
+    // Both are built from scratch, to compare how long that takes
+    const char *labels[] = {"separate", "unity"};
+    char *out_files[] = {"build/bench-separate.json", "build/bench-unity.json"};
+    double build_s[2];
+    cache_size = 0;
+    for (size_t i = 0; i < 2; ++i) {
+      unity = i == 1;
+      rebuild = true;
+      uint64_t start = clock_now_ns();
+      com_driver(bench_profile, bench_target, bench_src_file);
+      build_s[i] = (double)(clock_now_ns() - start) / 1e9;
+      // Just built from scratch, `run_bench()` finds it up to date
+      rebuild = false;
+      run_bench(bench_profile, &args, labels[i], out_files[i]);
+    }
+    printf("\nBuilding %s with the %s profile, -j %zu:\n", bench_target,
+           profile_names[bench_profile], jobs > 0 ? jobs : cpu_count());
+    for (size_t i = 0; i < 2; ++i) {
+      printf("%-10s %8.2f s\n", labels[i], build_s[i]);
+    }
+    bench_report(labels, out_files, 2);
+    return;
+  }
+  if (!profile_all) {
+    run_bench(bench_profile, &args, nullptr, nullptr);
+    return;
+  }
+  // The debug profile prints every token, there is no point measuring it
+  profile_t profiles[] = {profile_release, profile_lto, profile_pgo};
+  const size_t profiles_count = sizeof(profiles) / sizeof(profile_t);
+  const char *labels[sizeof(profiles) / sizeof(profile_t)];
+  char *out_files[sizeof(profiles) / sizeof(profile_t)];
+  for (size_t i = 0; i < profiles_count; ++i) {
+    labels[i] = profile_names[profiles[i]];
+    out_files[i] = arena_alloc(&arena, 64);
+    sprintf(out_files[i], "build/bench-%s.json", labels[i]);
+    run_bench(profiles[i], &args, labels[i], out_files[i]);
+  }
+  bench_report(labels, out_files, profiles_count);
+}
+
+/// Builds the tests and runs them, exiting with 1 if any fails.
+void com_and_run_test(int *argc, char ***argv) {
+  com_driver(profile == profiles_len ? profile_release : profile, test_target,
+             test_src_file);
+  if (!make_dir("build/tests/")) exit(1);
+  cmd(run_cmd, &allocator);
+  char run_exe[BIN_NAME_MAX_SZ + 8];
+#if defined(BUILD_WINDOWS)
+  sprintf(run_exe, "%s.exe", test_target);
+#else
+  sprintf(run_exe, "./%s", test_target);
+#endif
+  char cc_arg[32];
+  snprintf(cc_arg, sizeof(cc_arg), "--cc=%s", cc);
+  cmd_append(run_cmd, &allocator, run_exe, cc_arg);
+  while (*argc > 0) {
+    char *arg = utils_shift_args(argc, argv);
+    cmd_append(run_cmd, &allocator, arg);
+  }
+  print_cmd("Running tests", &run_cmd);
+  if (!cmd_run_sync(run_cmd)) exit(1);
+}
+
 void com_and_run_prg(int *argc, char ***argv) {
   com_prg();
   cmd_t run_cmd;
@@ -158,13 +992,17 @@ int main(int argc, char **argv) {
     rda_append(test, &allocator, 1, 2, 3, 4);
   } else if (!strcmp(subcommand, "com")) {
     // TODO: implement an option to turn on/off the sanitizer for compilation.
+    parse_build_args(&argc, &argv);
     com_prg();
   } else if (!strcmp(subcommand, "run")) {
-    char *arg = utils_shift_args_p(&argc, &argv);
-    if (arg && strcmp(arg, "--")) {
-      fprintf(stderr, "Error: no valid argument provided to run subcommand\n");
-    }
+    parse_build_args(&argc, &argv);
     com_and_run_prg(&argc, &argv);
+  } else if (!strcmp(subcommand, "bench")) {
+    parse_build_args(&argc, &argv);
+    com_and_run_bench(&argc, &argv);
+  } else if (!strcmp(subcommand, "test")) {
+    parse_build_args(&argc, &argv);
+    com_and_run_test(&argc, &argv);
   } else {
     help_msg(utils_shift_args_p(&argc, &argv), prg);
     fprintf(stderr, "Error: unknown subcommand %s\n", subcommand);
@@ -1,18 +1,204 @@
 #include "allocator.h"
 
-#define ARENA_ALLOCATOR_IMPLEMENTATION
-#include "libraries/arena_allocator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defines.h"
+
+/// @internal
+/// Room an allocation of `t_size` bytes takes. An empty one takes some too,
+/// or it would share its address with the next one, and `realloc()` and
+/// `free()` would take it for that one.
+INTERNAL_DEF size_t arena_align(size_t t_size) {
+  if (t_size == 0) return ARENA_ALLOCATOR_ALIGN;
+  return (t_size + ARENA_ALLOCATOR_ALIGN - 1) &
+         ~(size_t)(ARENA_ALLOCATOR_ALIGN - 1);
+}
+
+/// @internal
+INTERNAL_DEF void arena_grow_peak(arena_allocator_t *t_arena) {
+  if (t_arena->reserved > t_arena->peak) t_arena->peak = t_arena->reserved;
+}
+
+/// @internal
+/// Starts a block with room for at least `t_size` bytes, what is left of the
+/// current one is wasted.
+INTERNAL_DEF void arena_push_block(arena_allocator_t *t_arena,
+                                   size_t t_size) {
+  size_t size =
+      t_size > ARENA_ALLOCATOR_BLOCK_SIZE ? t_size : ARENA_ALLOCATOR_BLOCK_SIZE;
+  arena_block *block = malloc(sizeof(arena_block) + size);
+  if (!block) {
+    fprintf(stderr, "Error: out of memory\n");
+    exit(1);
+  }
+  if (t_arena->head) {
+    t_arena->wasted += t_arena->head->size - t_arena->head->used;
+  }
+  *block = (arena_block){.prev = t_arena->head, .size = size, .used = 0};
+  t_arena->head = block;
+  t_arena->top = nullptr;
+  t_arena->reserved += size;
+  t_arena->blocks++;
+  arena_grow_peak(t_arena);
+}
 
 void *arena_allocator_alloc(void *t_arena, size_t t_size_in_bytes) {
-  return arena_alloc((Arena *)t_arena, t_size_in_bytes);
+  arena_allocator_t *arena = t_arena;
+  size_t size = arena_align(t_size_in_bytes);
+  if (!arena->head || arena->head->size - arena->head->used < size) {
+    arena_push_block(arena, size);
+  }
+  arena_block *head = arena->head;
+  void *ptr = (char *)head->data + head->used;
+  head->used += size;
+  arena->used += size;
+  arena->top = ptr;
+  return ptr;
 }
+
 void arena_allocator_free(void *t_arena, void *t_ptr) {
-  (void)t_ptr;
-  arena_free((Arena *)t_arena);
+  arena_allocator_t *arena = t_arena;
+  if (t_ptr) {
+    if (t_ptr == arena->top) {
+      size_t offset = (size_t)((char *)t_ptr - (char *)arena->head->data);
+      arena->used -= arena->head->used - offset;
+      arena->head->used = offset;
+      arena->top = nullptr;
+    }
+    return;
+  }
+
+#ifdef DEBUG
+  if (arena->head) arena_allocator_print(arena);
+#endif  // DEBUG
+  arena_block *block = arena->head;
+  while (block) {
+    arena_block *prev = block->prev;
+    free(block);
+    block = prev;
+  }
+  *arena = (arena_allocator_t){.head = nullptr,
+                               .top = nullptr,
+                               .reserved = 0,
+                               .used = 0,
+                               .wasted = 0,
+                               .peak = arena->peak,
+                               .blocks = arena->blocks};
 }
+
 void *arena_allocator_realloc(void *t_arena, void *t_old_ptr,
                               size_t t_old_size_in_bytes,
                               size_t t_new_size_in_bytes) {
-  return arena_realloc((Arena *)t_arena, t_old_ptr, t_old_size_in_bytes,
-                       t_new_size_in_bytes);
+  arena_allocator_t *arena = t_arena;
+  if (!t_old_ptr) return arena_allocator_alloc(t_arena, t_new_size_in_bytes);
+  if (t_new_size_in_bytes <= t_old_size_in_bytes) return t_old_ptr;
+
+  size_t new_size = arena_align(t_new_size_in_bytes);
+  if (t_old_ptr == arena->top) {
+    arena_block *head = arena->head;
+    size_t offset = (size_t)((char *)t_old_ptr - (char *)head->data);
+    if (head->size - offset >= new_size) {
+      arena->used += offset + new_size - head->used;
+      head->used = offset + new_size;
+      return t_old_ptr;
+    }
+    // The allocation is alone in its block, so the whole block can be
+    // reallocated, which for big blocks remaps pages instead of copying them
+    if (offset == 0) {
+      arena_block *block = realloc(head, sizeof(arena_block) + new_size);
+      if (!block) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+      }
+      arena->reserved += new_size - block->size;
+      arena->used += new_size - block->used;
+      arena_grow_peak(arena);
+      block->size = new_size;
+      block->used = new_size;
+      arena->head = block;
+      arena->top = block->data;
+      return block->data;
+    }
+  }
+
+  void *ptr = arena_allocator_alloc(t_arena, t_new_size_in_bytes);
+  memcpy(ptr, t_old_ptr, t_old_size_in_bytes);
+  arena->wasted += arena_align(t_old_size_in_bytes);
+  return ptr;
+}
+
+void arena_allocator_reset(void *t_arena) {
+  arena_allocator_t *arena = t_arena;
+  arena_block *keep = arena->head;
+  if (!keep) return;
+  arena_block *block = keep->prev;
+  while (block) {
+    arena_block *prev = block->prev;
+    free(block);
+    block = prev;
+  }
+  keep->prev = nullptr;
+  keep->used = 0;
+  *arena = (arena_allocator_t){.head = keep,
+                               .top = nullptr,
+                               .reserved = keep->size,
+                               .used = 0,
+                               .wasted = 0,
+                               .peak = arena->peak,
+                               .blocks = arena->blocks};
+}
+
+void arena_allocator_print(const arena_allocator_t *t_arena) {
+  fprintf(stderr,
+          "arena: %zu bytes reserved (peak %zu) in %zu blocks, %zu used, %zu "
+          "wasted\n",
+          t_arena->reserved, t_arena->peak, t_arena->blocks, t_arena->used,
+          t_arena->wasted);
+}
+
+/// @internal
+INTERNAL_DEF void *allocator_counter_alloc(void *t_counter,
+                                           size_t t_size_in_bytes) {
+  allocator_counter_t *counter = t_counter;
+  counter->allocs++;
+  counter->requested += t_size_in_bytes;
+  return counter->inner->alloc(counter->inner->m_ctx, t_size_in_bytes);
+}
+
+/// @internal
+INTERNAL_DEF void allocator_counter_free(void *t_counter, void *t_ptr) {
+  allocator_counter_t *counter = t_counter;
+  counter->inner->free(counter->inner->m_ctx, t_ptr);
+}
+
+/// @internal
+INTERNAL_DEF void *allocator_counter_realloc(void *t_counter, void *t_old_ptr,
+                                             size_t t_old_size_in_bytes,
+                                             size_t t_new_size_in_bytes) {
+  allocator_counter_t *counter = t_counter;
+  counter->allocs++;
+  if (t_new_size_in_bytes > t_old_size_in_bytes) {
+    counter->requested += t_new_size_in_bytes - t_old_size_in_bytes;
+  }
+  // The arena knows what a move left behind, a block it reallocated whole
+  // leaves nothing even though its address changed
+  if (counter->inner->realloc == arena_allocator_realloc) {
+    arena_allocator_t *arena = counter->inner->m_ctx;
+    size_t wasted = arena->wasted;
+    void *ptr = arena_allocator_realloc(arena, t_old_ptr, t_old_size_in_bytes,
+                                        t_new_size_in_bytes);
+    counter->moved += arena->wasted - wasted;
+    return ptr;
+  }
+  void *ptr = counter->inner->realloc(counter->inner->m_ctx, t_old_ptr,
+                                      t_old_size_in_bytes, t_new_size_in_bytes);
+  if (t_old_ptr && ptr != t_old_ptr) counter->moved += t_old_size_in_bytes;
+  return ptr;
+}
+
+rda_allocator allocator_counter_wrap(allocator_counter_t *t_counter) {
+  return (rda_allocator){allocator_counter_alloc, allocator_counter_free,
+                         allocator_counter_realloc, t_counter};
 }
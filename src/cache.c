@@ -0,0 +1,149 @@
+#include "cache.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defines.h"
+#include "files.h"
+#include "libraries/rit_dyn_arr.h"
+#include "libraries/rit_str.h"
+#include "optimizer.h"
+
+/// Changes every key when what is stored or how keys are made changes
+#define CACHE_FORMAT 2
+/// Hex digits of a key in an entry's name
+#define CACHE_KEY_LEN 16
+
+/// @internal
+/// Path of the entry of `t_key` in `t_buffer`.
+INTERNAL_DEF void cache_path(const cache_t *t_cache, uint64_t t_key,
+                             const char *t_ext, char *t_buffer,
+                             size_t t_buffer_size) {
+  snprintf(t_buffer, t_buffer_size, "%s%016llx%s", t_cache->dir,
+           (unsigned long long)t_key, t_ext);
+}
+
+/// @internal
+/// Hashes the running executable into `t_build`, so a rebuilt compiler does
+/// not reuse what an older one generated even if `THOR_VERSION` was not
+/// bumped.
+INTERNAL_DEF bool cache_build_id(uint64_t *t_build) {
+  *t_build = HASH_FNV_OFFSET;
+#if defined(BUILD_WINDOWS)
+  char path[MAX_PATH];
+  DWORD len = GetModuleFileNameA(NULL, path, sizeof(path));
+  if (len == 0 || len == sizeof(path)) {
+    fprintf(stderr, "Error: could not find the compiler's executable: %lu\n",
+            GetLastError());
+    return false;
+  }
+#else
+  const char *path = "/proc/self/exe";
+#endif  // BUILD_WINDOWS
+  if (!hash_file(t_build, path)) {
+    fprintf(stderr, "Error: could not read the compiler's executable `%s`\n",
+            path);
+    return false;
+  }
+  return true;
+}
+
+bool cache_init(cache_t *t_cache, const char *t_dir, size_t t_max_size) {
+  size_t len = strlen(t_dir);
+  bool has_sep = len > 0 && (t_dir[len - 1] == '/' || t_dir[len - 1] == '\\');
+  // Room for the separator and an entry's name after it
+  if (len == 0 || len + 1 + CACHE_KEY_LEN + 16 >= sizeof(t_cache->dir)) {
+    fprintf(stderr, "Error: invalid cache directory `%s`\n", t_dir);
+    return false;
+  }
+  memcpy(t_cache->dir, t_dir, len);
+  if (!has_sep) t_cache->dir[len++] = '/';
+  t_cache->dir[len] = '\0';
+  t_cache->max_size = t_max_size;
+  if (!cache_build_id(&t_cache->build)) return false;
+
+#if defined(BUILD_WINDOWS)
+  if (!CreateDirectoryA(t_dir, NULL) &&
+      GetLastError() != ERROR_ALREADY_EXISTS) {
+    fprintf(stderr, "Error: could not create cache directory `%s`: %lu\n",
+            t_dir, GetLastError());
+    return false;
+  }
+#else
+  if (mkdir(t_dir, 0755) < 0 && errno != EEXIST) {
+    fprintf(stderr, "Error: could not create cache directory `%s`: %s\n",
+            t_dir, strerror(errno));
+    return false;
+  }
+#endif  // BUILD_WINDOWS
+  return true;
+}
+
+uint64_t cache_key(const cache_t *t_cache, rsv t_src, opt_level t_level,
+                   const char *t_ext) {
+  uint64_t options[3] = {CACHE_FORMAT, t_cache->build, t_level};
+  uint64_t key = hash_bytes(HASH_FNV_OFFSET, options, sizeof(options));
+  key = hash_bytes(key, THOR_VERSION, sizeof(THOR_VERSION));
+  key = hash_bytes(key, t_ext, strlen(t_ext) + 1);
+  return hash_bytes(key, rsv_get(t_src), rsv_size(t_src));
+}
+
+bool cache_fetch(const cache_t *t_cache, uint64_t t_key, const char *t_ext,
+                 const char *t_out_file) {
+  char path[sizeof(t_cache->dir) + 32];
+  cache_path(t_cache, t_key, t_ext, path, sizeof(path));
+  bool success;
+  if (!strcmp(t_out_file, "-")) {
+    FILE *entry = fopen(path, "rb");
+    if (!entry) return false;
+    success = file_copy_stream(entry, stdout) && fflush(stdout) == 0;
+    fclose(entry);
+  } else {
+    success = file_copy(path, t_out_file);
+  }
+  // Eviction goes by modification time, so a hit makes the entry the newest
+  if (success) file_touch(path);
+  return success;
+}
+
+void cache_store(const cache_t *t_cache, uint64_t t_key, const char *t_ext,
+                 const char *t_out_file) {
+  // Workers of a batch, or other compilers, may store the same key at once,
+  // each copy goes through a temporary file of its own
+  char path[sizeof(t_cache->dir) + 32];
+  cache_path(t_cache, t_key, t_ext, path, sizeof(path));
+  if (!file_copy(t_out_file, path)) {
+    fprintf(stderr, "Error: could not store `%s` in the cache as `%s`\n",
+            t_out_file, path);
+  }
+}
+
+/// @internal
+/// Whether `t_path` is an entry, a key followed by an extension. Temporary
+/// files of stores in progress are not.
+INTERNAL_DEF bool cache_is_entry(const cache_t *t_cache, const char *t_path) {
+  const char *name = t_path + strlen(t_cache->dir);
+  if (strlen(name) <= CACHE_KEY_LEN) return false;
+  for (size_t i = 0; i < CACHE_KEY_LEN; ++i) {
+    char c = name[i];
+    if (!(c >= '0' && c <= '9') && !(c >= 'a' && c <= 'f')) return false;
+  }
+  return name[CACHE_KEY_LEN] == '.' && !strchr(name + CACHE_KEY_LEN + 1, '.');
+}
+
+void cache_evict(const cache_t *t_cache, rda_allocator *t_allocator) {
+  file_infos_t files = {};
+  rda_init(files, 0, sizeof(file_info_t), t_allocator);
+  files.m_size = 0;
+  if (!list_files(t_cache->dir, "", &files, t_allocator)) return;
+  // Only entries count, whatever else is in the directory is left alone
+  size_t len = 0;
+  rda_for_each(it, files) {
+    if (cache_is_entry(t_cache, it->path)) rda_data(files)[len++] = *it;
+  }
+  files.m_size = len;
+  evict_files(&files, t_cache->max_size);
+}
@@ -0,0 +1,230 @@
+#include "compiler.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "cache.h"
+#include "defines.h"
+#include "libraries/rit_dyn_arr.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "source.h"
+#include "thread.h"
+
+#if !defined(BUILD_WINDOWS)
+#include <dirent.h>
+#endif  // BUILD_WINDOWS
+
+#define COMPILER_SRC_EXT ".th"
+
+bool compile_file(const char *t_file, const char *t_out_file,
+                  const compiler_options *t_options,
+                  rda_allocator *t_allocator) {
+  timer_passes_t *timers = t_options->timers;
+  const cache_t *cache = timers ? nullptr : t_options->cache;
+  // Stdin is read once, by the parser, so it is never cached
+  if (cache && !strcmp(t_file, SOURCE_STDIN)) cache = nullptr;
+  char default_out[BIN_NAME_MAX_SZ];
+  if (!t_out_file) {
+    snprintf(default_out, sizeof(default_out), "out%s", t_options->out_ext);
+  }
+  const char *out_file = t_out_file ? t_out_file : default_out;
+  uint64_t key = 0;
+  if (cache) {
+    source_t source;
+    if (!source_open(&source, t_file, t_allocator)) return false;
+    key = cache_key(cache, source.view, t_options->level, t_options->out_ext);
+    source_close(&source);
+    if (cache_fetch(cache, key, t_options->out_ext, out_file)) return true;
+  }
+
+  parser_t parser;
+  if (!parser_init_with_allocator(&parser, t_file, t_options->lex_jobs, timers,
+                                  t_allocator)) {
+    return false;
+  }
+  uint64_t start = timer_start(timers);
+  bool success = parse(&parser);
+  timer_stop(timers, timer_parse, start,
+             tokens_size(&parser.tokenizer->tokens));
+  if (success) {
+    optimize(&parser.prg, &parser.tokenizer->symbols, t_allocator,
+             t_options->level, timers);
+    start = timer_start(timers);
+    success = t_options->backend(t_out_file, &parser.prg,
+                                 &parser.tokenizer->symbols, t_allocator);
+    timer_stop(timers, timer_generate, start, node_prg_size(&parser.prg));
+  }
+  parser_deinit(&parser);
+  if (success && cache && strcmp(out_file, "-")) {
+    cache_store(cache, key, t_options->out_ext, out_file);
+  }
+  return success;
+}
+
+/// @internal
+/// `t_file` with its `.th` extension, if it has one, replaced by `t_ext`.
+INTERNAL_DEF char *compiler_out_path(const char *t_file, const char *t_ext,
+                                     rda_allocator *t_allocator) {
+  size_t len = strlen(t_file);
+  size_t src_ext_len = strlen(COMPILER_SRC_EXT);
+  if (len >= src_ext_len &&
+      !strcmp(t_file + len - src_ext_len, COMPILER_SRC_EXT)) {
+    len -= src_ext_len;
+  }
+  size_t ext_len = strlen(t_ext);
+  char *out = t_allocator->alloc(t_allocator->m_ctx, len + ext_len + 1);
+  memcpy(out, t_file, len);
+  memcpy(out + len, t_ext, ext_len + 1);
+  return out;
+}
+
+/// @internal
+/// State shared by the workers of `compile_files()`. Files are handed out
+/// one at a time through `next`, so a worker that drew small files simply
+/// takes more of them.
+typedef struct {
+  char **files;
+  size_t files_len;
+  size_t next;  // Index of the next file to compile, updated atomically
+  bool failed;  // Set atomically by any worker whose file failed
+  const compiler_options *options;
+} compiler_batch;
+
+/// @internal
+INTERNAL_DEF void compiler_worker(void *t_batch) {
+  compiler_batch *batch = t_batch;
+  arena_allocator_t arena = {};
+  rda_allocator arena_allocator = {arena_allocator_alloc, arena_allocator_free,
+                                   arena_allocator_realloc, &arena};
+  rda_allocator allocator = arena_allocator;
+  // Phases are timed into totals of the worker's own, merged once at the end
+  compiler_options options = *batch->options;
+  timer_passes_t timers = {};
+  allocator_counter_t counter = {.inner = &arena_allocator};
+  if (options.timers) {
+    options.timers = &timers;
+    if (batch->options->timers->counter) {
+      allocator = allocator_counter_wrap(&counter);
+      timers.counter = &counter;
+      timers.arena = &arena;
+    }
+  }
+  while (true) {
+    size_t idx = thread_atomic_fetch_add(&batch->next, 1);
+    if (idx >= batch->files_len) break;
+    const char *file = batch->files[idx];
+    char *out_file = compiler_out_path(file, options.out_ext, &allocator);
+    if (!compile_file(file, out_file, &options, &allocator)) {
+      fprintf(stderr, "Error: could not compile `%s`\n", file);
+      thread_atomic_store_bool(&batch->failed, true);
+    }
+    // Nothing outlives a file, so reset the arena before the next one
+    arena_allocator_reset(&arena);
+  }
+  arena_allocator_free(&arena, nullptr);
+  if (options.timers) timer_merge(batch->options->timers, &timers);
+}
+
+bool compile_files(char **t_files, size_t t_files_len,
+                   const compiler_options *t_options, size_t t_jobs) {
+  compiler_batch batch = {.files = t_files,
+                          .files_len = t_files_len,
+                          .next = 0,
+                          .failed = false,
+                          .options = t_options};
+  size_t jobs = t_jobs ? t_jobs : thread_hardware_concurrency();
+  if (jobs > t_files_len) jobs = t_files_len;
+  if (jobs <= 1) {
+    compiler_worker(&batch);
+    return !batch.failed;
+  }
+
+  thread_t *threads = malloc(jobs * sizeof(thread_t));
+  size_t started = 0;
+  for (; started < jobs; ++started) {
+    if (!thread_create(&threads[started], compiler_worker, &batch)) break;
+  }
+  // Whatever threads could not be started, this one does their share
+  if (started < jobs) compiler_worker(&batch);
+  for (size_t i = 0; i < started; ++i) {
+    thread_join(threads[i]);
+  }
+  free(threads);
+  return !batch.failed;
+}
+
+/// @internal
+INTERNAL_DEF bool compiler_is_src(const char *t_name) {
+  size_t len = strlen(t_name);
+  size_t src_ext_len = strlen(COMPILER_SRC_EXT);
+  return len > src_ext_len &&
+         !strcmp(t_name + len - src_ext_len, COMPILER_SRC_EXT);
+}
+
+/// @internal
+INTERNAL_DEF void compiler_push_path(const char *t_dir, const char *t_name,
+                                     compiler_files_t *t_files,
+                                     rda_allocator *t_allocator) {
+  size_t dir_len = strlen(t_dir);
+  size_t name_len = strlen(t_name);
+  bool has_sep = dir_len > 0 && (t_dir[dir_len - 1] == '/' ||
+                                 t_dir[dir_len - 1] == '\\');
+  char *path = t_allocator->alloc(t_allocator->m_ctx,
+                                  dir_len + !has_sep + name_len + 1);
+  memcpy(path, t_dir, dir_len);
+  if (!has_sep) path[dir_len] = '/';
+  memcpy(path + dir_len + !has_sep, t_name, name_len + 1);
+  rda_push_back(*t_files, path, t_allocator);
+}
+
+bool compiler_is_dir(const char *t_path) {
+#if defined(BUILD_WINDOWS)
+  DWORD attributes = GetFileAttributesA(t_path);
+  return attributes != INVALID_FILE_ATTRIBUTES &&
+         (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+  struct stat st;
+  return stat(t_path, &st) == 0 && S_ISDIR(st.st_mode);
+#endif  // BUILD_WINDOWS
+}
+
+bool compiler_list_dir(const char *t_dir, compiler_files_t *t_files,
+                       rda_allocator *t_allocator) {
+#if defined(BUILD_WINDOWS)
+  char pattern[MAX_PATH];
+  snprintf(pattern, sizeof(pattern), "%s\\*" COMPILER_SRC_EXT, t_dir);
+  WIN32_FIND_DATAA data;
+  HANDLE find = FindFirstFileA(pattern, &data);
+  if (find == INVALID_HANDLE_VALUE) {
+    if (GetLastError() == ERROR_FILE_NOT_FOUND) return true;
+    fprintf(stderr, "Error: could not open directory `%s`: %lu\n", t_dir,
+            GetLastError());
+    return false;
+  }
+  do {
+    if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
+        compiler_is_src(data.cFileName)) {
+      compiler_push_path(t_dir, data.cFileName, t_files, t_allocator);
+    }
+  } while (FindNextFileA(find, &data));
+  FindClose(find);
+#else
+  DIR *dir = opendir(t_dir);
+  if (!dir) {
+    fprintf(stderr, "Error: could not open directory `%s`: %s\n", t_dir,
+            strerror(errno));
+    return false;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir))) {
+    if (entry->d_type != DT_DIR && compiler_is_src(entry->d_name)) {
+      compiler_push_path(t_dir, entry->d_name, t_files, t_allocator);
+    }
+  }
+  closedir(dir);
+#endif  // BUILD_WINDOWS
+  return true;
+}
@@ -0,0 +1,299 @@
+#include "jit.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "defines.h"
+#include "libraries/rit_dyn_arr.h"
+#include "parser.h"
+#include "symbols.h"
+
+#ifdef JIT_SUPPORTED
+#include <sys/mman.h>
+
+/// @internal
+typedef enum {
+  jit_enter,     // Evaluate the expression into rax
+  jit_save_lhs,  // The left operand is in rax, spill it to the frame
+  jit_apply,     // Both operands are ready, apply the operator
+} jit_state;
+
+/// @internal
+typedef struct {
+  expr_idx idx;
+  jit_state state;
+} jit_frame;
+
+/// @internal
+typedef struct {
+  jit_program *jit_prg;
+  node_prg *prg;
+  symbols_t *symbols;
+  rda_struct(jit_frame) stack;  // Scratch for `jit_compile_expr()`
+  uint32_t *slots;              // Symbol id -> variable slot + 1, 0 if not
+                                // declared yet
+  uint32_t slots_len;
+  size_t spills_base;  // Offset of the first spill slot, after the variables
+  size_t spills_len;   // Spill slots in use
+  rda_allocator *allocator;
+} jit_compiler;
+
+/// @internal
+INTERNAL_DEF void jit_emit(jit_compiler *t_jit, const uint8_t *t_bytes,
+                           size_t t_len) {
+  for (size_t i = 0; i < t_len; ++i) {
+    rda_push_back(t_jit->jit_prg->code, t_bytes[i], t_jit->allocator);
+  }
+}
+
+#define jit_emit_lit(t_jit, ...)                       \
+  jit_emit(t_jit, (const uint8_t[]){__VA_ARGS__},      \
+           sizeof((const uint8_t[]){__VA_ARGS__}))
+
+/// @internal
+/// Little-endian, like every immediate and displacement on x86-64.
+INTERNAL_DEF void jit_emit_le(jit_compiler *t_jit, uint64_t t_value,
+                              size_t t_len) {
+  for (size_t i = 0; i < t_len; ++i) {
+    rda_push_back(t_jit->jit_prg->code, (uint8_t)(t_value >> (i * 8)),
+                  t_jit->allocator);
+  }
+}
+
+/// @internal
+/// Emits `t_opcode` with a ModRM byte addressing `[rdi + t_offset]`, the frame
+/// is passed in rdi. `t_reg` is 0 for rax/eax and 1 for rcx.
+INTERNAL_DEF bool jit_emit_frame_op(jit_compiler *t_jit, uint8_t t_rex,
+                                    uint8_t t_opcode, uint8_t t_reg,
+                                    size_t t_offset) {
+  if (t_offset > INT32_MAX) {
+    fprintf(stderr, "Error: the program needs too much stack to JIT\n");
+    return false;
+  }
+  if (t_rex) jit_emit_lit(t_jit, t_rex);
+  // mod = 10 (disp32), rm = 111 (rdi)
+  jit_emit_lit(t_jit, t_opcode, (uint8_t)(0x87 | (t_reg << 3)));
+  jit_emit_le(t_jit, t_offset, 4);
+  return true;
+}
+
+/// @internal
+/// Loads a number or a variable into rax (`t_reg` 0) or rcx (`t_reg` 1).
+/// Variables are 32-bit, like the `int`s of the C backend, and are
+/// sign-extended on load.
+INTERNAL_DEF bool jit_load(jit_compiler *t_jit, node_expr *t_expr,
+                           uint8_t t_reg) {
+  if (t_expr->type == expr_var) {
+    symbol_id sym = t_expr->value.var_expr;
+    if (!t_jit->slots[sym]) {
+      rsv name = symbols_name(t_jit->symbols, sym);
+      fprintf(stderr, "Error: `%.*s` is used before it is declared\n",
+              (int)rsv_size(name), rsv_get(name));
+      return false;
+    }
+    // movsxd reg, dword [rdi + slot]
+    return jit_emit_frame_op(t_jit, 0x48, 0x63, t_reg,
+                             (size_t)(t_jit->slots[sym] - 1) * 4);
+  }
+  int64_t value = t_expr->value.num_expr.value;
+  if (value == (int32_t)value) {
+    // mov reg, imm32 (sign-extended)
+    jit_emit_lit(t_jit, 0x48, 0xC7, (uint8_t)(0xC0 | t_reg));
+    jit_emit_le(t_jit, (uint64_t)value, 4);
+  } else {
+    // movabs reg, imm64
+    jit_emit_lit(t_jit, 0x48, (uint8_t)(0xB8 | t_reg));
+    jit_emit_le(t_jit, (uint64_t)value, 8);
+  }
+  return true;
+}
+
+/// @internal
+/// Computes `rax = rax op rcx` with 64-bit wrapping arithmetic.
+INTERNAL_DEF void jit_op(jit_compiler *t_jit, token_type t_op) {
+  switch (t_op) {
+    case token_plus: {
+      jit_emit_lit(t_jit, 0x48, 0x01, 0xC8);  // add rax, rcx
+      break;
+    }
+    case token_minus: {
+      jit_emit_lit(t_jit, 0x48, 0x29, 0xC8);  // sub rax, rcx
+      break;
+    }
+    case token_star: {
+      jit_emit_lit(t_jit, 0x48, 0x0F, 0xAF, 0xC1);  // imul rax, rcx
+      break;
+    }
+    case token_fslash: {
+      // The frame pointer in rdi is kept, only rdx is clobbered
+      jit_emit_lit(t_jit, 0x48, 0x99);        // cqo
+      jit_emit_lit(t_jit, 0x48, 0xF7, 0xF9);  // idiv rcx
+      break;
+    }
+    default: {
+      fprintf(stderr, "Error: unknown operator %s\n", token_type_to_str(t_op));
+      exit(1);
+    }
+  }
+}
+
+/// @internal
+/// Evaluates the expression into rax with an explicit stack. A left operand
+/// is spilled to the frame only when the right operand is itself a binary
+/// expression, otherwise the right operand is loaded into rcx directly.
+INTERNAL_DEF bool jit_compile_expr(jit_compiler *t_jit, expr_idx t_idx) {
+  t_jit->stack.m_size = 0;
+  jit_frame root = {.idx = t_idx, .state = jit_enter};
+  rda_push_back(t_jit->stack, root, t_jit->allocator);
+  while (rda_size(t_jit->stack) > 0) {
+    jit_frame frame = rda_at(t_jit->stack, rda_size(t_jit->stack) - 1);
+    t_jit->stack.m_size--;
+    node_expr *expr = node_prg_expr(t_jit->prg, frame.idx);
+    if (expr->type != expr_bin) {
+      if (!jit_load(t_jit, expr, 0)) return false;
+      continue;
+    }
+    node_bin_expr bin = expr->value.bin_expr;
+    node_expr *rhs = node_prg_expr(t_jit->prg, bin.rhs);
+    switch (frame.state) {
+      case jit_enter: {
+        frame.state = rhs->type == expr_bin ? jit_save_lhs : jit_apply;
+        rda_push_back(t_jit->stack, frame, t_jit->allocator);
+        jit_frame lhs = {.idx = bin.lhs, .state = jit_enter};
+        rda_push_back(t_jit->stack, lhs, t_jit->allocator);
+        break;
+      }
+      case jit_save_lhs: {
+        size_t offset = t_jit->spills_base + t_jit->spills_len++ * 8;
+        // mov [rdi + offset], rax
+        if (!jit_emit_frame_op(t_jit, 0x48, 0x89, 0, offset)) return false;
+        size_t frame_size = offset + 8;
+        if (frame_size > t_jit->jit_prg->frame_size) {
+          t_jit->jit_prg->frame_size = frame_size;
+        }
+        frame.state = jit_apply;
+        rda_push_back(t_jit->stack, frame, t_jit->allocator);
+        jit_frame rhs_frame = {.idx = bin.rhs, .state = jit_enter};
+        rda_push_back(t_jit->stack, rhs_frame, t_jit->allocator);
+        break;
+      }
+      case jit_apply: {
+        if (rhs->type == expr_bin) {
+          size_t offset = t_jit->spills_base + --t_jit->spills_len * 8;
+          jit_emit_lit(t_jit, 0x48, 0x89, 0xC1);  // mov rcx, rax
+          // mov rax, [rdi + offset]
+          if (!jit_emit_frame_op(t_jit, 0x48, 0x8B, 0, offset)) return false;
+        } else if (!jit_load(t_jit, rhs, 1)) {
+          return false;
+        }
+        jit_op(t_jit, bin.op);
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+bool jit_compile(jit_program *t_jit_prg, node_prg *t_prg, symbols_t *t_symbols,
+                 rda_allocator *t_allocator) {
+  rda_init(t_jit_prg->code, 0, sizeof(uint8_t), t_allocator);
+  t_jit_prg->code.m_size = 0;
+  t_jit_prg->frame_size = 0;
+  jit_compiler jit = {.jit_prg = t_jit_prg,
+                      .prg = t_prg,
+                      .symbols = t_symbols,
+                      .stack = {},
+                      .slots = nullptr,
+                      .slots_len = 0,
+                      .spills_base = 0,
+                      .spills_len = 0,
+                      .allocator = t_allocator};
+  rda_init(jit.stack, 0, sizeof(jit_frame), t_allocator);
+  size_t slots_size = symbols_size(t_symbols) * sizeof(uint32_t);
+  jit.slots = t_allocator->alloc(t_allocator->m_ctx, slots_size);
+  memset(jit.slots, 0, slots_size);
+  // Every declaration gets a 4 byte slot at the start of the frame
+  rda_for_each(it, t_prg->stmts) {
+    if (it->type == stmt_var_decl) jit.spills_base += 4;
+  }
+  jit.spills_base = (jit.spills_base + 7) & ~(size_t)7;
+  t_jit_prg->frame_size = jit.spills_base;
+
+  rda_for_each(it, t_prg->stmts) {
+    switch (it->type) {
+      case stmt_exit: {
+        if (!jit_compile_expr(&jit, it->value.exit_stmt.status)) return false;
+        jit_emit_lit(&jit, 0xC3);  // ret, the status is in eax
+        break;
+      }
+      case stmt_var_decl: {
+        node_stmt_var_decl *decl = &it->value.var_decl_stmt;
+        if (!jit_compile_expr(&jit, decl->expr)) return false;
+        // A redeclaration reuses the slot of the first one
+        if (!jit.slots[decl->name]) jit.slots[decl->name] = ++jit.slots_len;
+        // mov dword [rdi + slot], eax
+        if (!jit_emit_frame_op(&jit, 0, 0x89, 0,
+                               (size_t)(jit.slots[decl->name] - 1) * 4)) {
+          return false;
+        }
+        break;
+      }
+      default: {
+        fprintf(stderr, "Error: unknown statment type\n");
+        exit(1);
+      }
+    }
+  }
+  jit_emit_lit(&jit, 0x31, 0xC0, 0xC3);  // xor eax, eax; ret
+  return true;
+}
+
+bool jit_run(jit_program *t_jit_prg, int *t_status,
+             rda_allocator *t_allocator) {
+  size_t code_size = rda_size(t_jit_prg->code);
+  // Written while mapped read-write, executed once it is read-execute, so
+  // the page is never writable and executable at the same time
+  void *code = mmap(nullptr, code_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code == MAP_FAILED) {
+    fprintf(stderr, "Error: could not map memory for the JIT: %s\n",
+            strerror(errno));
+    return false;
+  }
+  memcpy(code, rda_data(t_jit_prg->code), code_size);
+  if (mprotect(code, code_size, PROT_READ | PROT_EXEC) < 0) {
+    fprintf(stderr, "Error: could not make the JIT code executable: %s\n",
+            strerror(errno));
+    munmap(code, code_size);
+    return false;
+  }
+  // At least 8 bytes, so an empty frame does not allocate 0 bytes
+  int64_t *frame = t_allocator->alloc(t_allocator->m_ctx,
+                                      t_jit_prg->frame_size + 8);
+  int (*fn)(int64_t *) = (int (*)(int64_t *))code;
+  *t_status = fn(frame);
+  munmap(code, code_size);
+  return true;
+}
+
+#else
+bool jit_compile(jit_program *t_jit_prg, node_prg *t_prg, symbols_t *t_symbols,
+                 rda_allocator *t_allocator) {
+  (void)t_jit_prg;
+  (void)t_prg;
+  (void)t_symbols;
+  (void)t_allocator;
+  fprintf(stderr, "Error: the JIT is only supported on Linux x86-64\n");
+  return false;
+}
+
+bool jit_run(jit_program *t_jit_prg, int *t_status,
+             rda_allocator *t_allocator) {
+  (void)t_jit_prg;
+  (void)t_status;
+  (void)t_allocator;
+  return false;
+}
+#endif  // JIT_SUPPORTED
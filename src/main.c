@@ -2,14 +2,22 @@
 #include <stdlib.h>
 
 #include "allocator.h"
+#include "cache.h"
+#include "compiler.h"
 #include "defines.h"
 #include "generator.h"
-#include "libraries/arena_allocator.h"
+#include "generator_x86_64.h"
+#include "jit.h"
+#include "optimizer.h"
 #include "parser.h"
+#include "pipeline.h"
+#include "stream.h"
+#include "timer.h"
 #include "tokenizer.h"
 #include "utils.h"
+#include "vm.h"
 
-Arena arena = {nullptr, nullptr};
+arena_allocator_t arena = {};
 rstr_allocator allocator = {arena_allocator_alloc, arena_allocator_free,
                             arena_allocator_realloc, &arena};
 
@@ -21,9 +29,71 @@ void help_msg(const char *subcmd, const char *utils_prg_name) {
     printf("    run     Compile and run .th file\n");
     printf("    help    Print this help usage information\n");
   } else if (!strcmp(subcmd, "com")) {
-    printf("No help information avalaible for the \"com\" subcommand\n");
+    printf("Usage: %s com [-O0|-O1] [--backend=c|asm] [--pipeline|--stream] "
+           "[--time-passes[=json]] [--mem-stats[=json]] [--cache-dir=dir] "
+           "[--cache-size=MB] [-j jobs] [-o out] [files...]\n",
+           utils_prg_name);
+    printf("args:\n");
+    printf("    files   The .th files to compile, `-` reads from stdin. A "
+           "directory stands for\n"
+           "            the .th files in it. With several files, each output "
+           "is written next to\n"
+           "            its input, like a.th to a.c\n");
+    printf("    -j      How many files to compile at once, defaults to the "
+           "number of cores\n");
+    printf("    --lex-jobs=N  Lex each file on N threads, worth it for files "
+           "of many MB\n");
+    printf("    --pipeline    Lex, parse and generate C for a single file at "
+           "the same time,\n"
+           "                  on three threads, implies -O0\n");
+    printf("    --stream      Compile a single file to C in constant memory, "
+           "however big it is,\n"
+           "                  implies -O0\n");
+    printf("    --time-passes  Print how long each phase took to stderr, "
+           "summed over all\n"
+           "                   files, `=json` prints it as JSON\n");
+    printf("    --mem-stats    Print what each phase allocated to stderr, "
+           "summed over all\n"
+           "                   files, `=json` prints it as JSON\n");
+    printf("    --cache-dir=dir  Keep the generated code in dir, keyed by the "
+           "source, the\n"
+           "                     compiler and the options, and copy it from "
+           "there when a file\n"
+           "                     is compiled again unchanged. Defaults to "
+           "$" CACHE_DIR_ENV ", if\n"
+           "                     set. Not used with --pipeline, --stream or "
+           "--time-passes\n");
+    printf("    --cache-size=MB  Evict the least recently used code past this "
+           "size, defaults\n"
+           "                     to %d\n",
+           CACHE_DEFAULT_SIZE_MB);
+    printf("    -O0     Generate the program as written\n");
+    printf("    -O1     Fold constants and drop dead variables, the default\n");
+    printf("    --backend=c    Generate C, the default\n");
+    printf("    --backend=asm  Generate x86-64 assembly for Linux, it "
+           "assembles and links\n"
+           "                   without a C compiler or libc\n");
+    printf("    -o      Where to write the generated code, `-` writes to "
+           "stdout, defaults to\n"
+           "            out.c or out.s\n");
   } else if (!strcmp(subcmd, "run")) {
-    printf("No help information avalaible for the \"run\" subcommand\n");
+    printf("Usage: %s run [-O0|-O1] [--jit] [--time-passes[=json]] "
+           "[--mem-stats[=json]] [file]\n",
+           utils_prg_name);
+    printf("Runs the program on a bytecode interpreter, without a C compiler, "
+           "and exits\nwith the status it exits with\n");
+    printf("args:\n");
+    printf("    file    The .th file to run, `-` reads from stdin\n");
+    printf("    --jit   Compile to machine code in memory and run it natively, "
+           "Linux x86-64\n            only\n");
+    printf("    --time-passes  Print how long each phase took to stderr, "
+           "`=json` prints it\n"
+           "                   as JSON\n");
+    printf("    --mem-stats    Print what each phase allocated to stderr, "
+           "`=json` prints it\n"
+           "                   as JSON\n");
+    printf("    -O0     Run the program as written\n");
+    printf("    -O1     Fold constants and drop dead variables, the default\n");
   } else {
     fprintf(stderr, "Error: unknown subcommand %s\n", subcmd);
     exit(1);
@@ -43,11 +113,223 @@ int main(int argc, char **argv) {
   if (!strcmp(subcmd, "help")) {
     help_msg(utils_shift_args_p(&argc, &argv), prg);
   } else if (!strcmp(subcmd, "com")) {
-    parser_create(parser, "examples/variables.th");
-    parse(&parser);
-    parser_deinit(&parser);
+    compiler_files_t files = {};
+    rda_init(files, 0, sizeof(char *), &allocator);
+    files.m_size = 0;
+    bool batch = false;
+    bool pipelined = false;
+    bool streamed = false;
+    bool time_passes = false;
+    bool time_passes_json = false;
+    bool mem_stats = false;
+    bool mem_stats_json = false;
+    size_t jobs = 0;
+    char *out_file = nullptr;
+    const char *cache_dir = getenv(CACHE_DIR_ENV);
+    size_t cache_size = CACHE_DEFAULT_SIZE_MB;
+    compiler_options options = {.level = opt_level_1,
+                                .backend = generate,
+                                .out_ext = ".c",
+                                .lex_jobs = 0,
+                                .timers = nullptr,
+                                .cache = nullptr};
+    while (argc > 0) {
+      char *arg = utils_shift_args(&argc, &argv);
+      if (!strcmp(arg, "-O0")) {
+        options.level = opt_level_0;
+      } else if (!strcmp(arg, "-O1")) {
+        options.level = opt_level_1;
+      } else if (!strcmp(arg, "--backend=c")) {
+        options.backend = generate;
+        options.out_ext = ".c";
+      } else if (!strcmp(arg, "--backend=asm")) {
+        options.backend = generate_x86_64;
+        options.out_ext = ".s";
+      } else if (!strncmp(arg, "--backend=", strlen("--backend="))) {
+        fprintf(stderr, "Error: unknown backend %s\n",
+                arg + strlen("--backend="));
+        return 1;
+      } else if (!strcmp(arg, "-o")) {
+        out_file = utils_shift_args(&argc, &argv);
+      } else if (!strncmp(arg, "--lex-jobs=", strlen("--lex-jobs="))) {
+        if (!utils_parse_count("--lex-jobs", arg + strlen("--lex-jobs="), 0,
+                               &options.lex_jobs)) {
+          return 1;
+        }
+      } else if (!strcmp(arg, "--pipeline")) {
+        pipelined = true;
+      } else if (!strcmp(arg, "--stream")) {
+        streamed = true;
+      } else if (!strcmp(arg, "--time-passes")) {
+        time_passes = true;
+      } else if (!strcmp(arg, "--time-passes=json")) {
+        time_passes = true;
+        time_passes_json = true;
+      } else if (!strcmp(arg, "--mem-stats")) {
+        mem_stats = true;
+      } else if (!strcmp(arg, "--mem-stats=json")) {
+        mem_stats = true;
+        mem_stats_json = true;
+      } else if (!strncmp(arg, "--cache-dir=", strlen("--cache-dir="))) {
+        cache_dir = arg + strlen("--cache-dir=");
+      } else if (!strncmp(arg, "--cache-size=", strlen("--cache-size="))) {
+        if (!utils_parse_count("--cache-size", arg + strlen("--cache-size="),
+                               0, &cache_size)) {
+          return 1;
+        }
+      } else if (!strcmp(arg, "-j")) {
+        if (!utils_parse_count("-j", utils_shift_args(&argc, &argv), 1,
+                               &jobs)) {
+          return 1;
+        }
+      } else if (compiler_is_dir(arg)) {
+        if (!compiler_list_dir(arg, &files, &allocator)) return 1;
+        batch = true;
+      } else {
+        rda_push_back(files, arg, &allocator);
+      }
+    }
+    if (rda_size(files) > 1) batch = true;
+    if (pipelined && (batch || options.backend != generate)) {
+      fprintf(stderr, "Error: --pipeline only compiles a single file to C\n");
+      return 1;
+    }
+    if (streamed && (batch || pipelined || options.backend != generate)) {
+      fprintf(stderr, "Error: --stream only compiles a single file to C, "
+              "without --pipeline\n");
+      return 1;
+    }
+    if ((time_passes || mem_stats) && (pipelined || streamed)) {
+      fprintf(stderr, "Error: --time-passes and --mem-stats cannot measure "
+              "--pipeline or --stream, their phases overlap\n");
+      return 1;
+    }
+    timer_passes_t timers = {};
+    if (time_passes || mem_stats) options.timers = &timers;
+    // Counts what the phases allocate, batch workers wrap their own arenas
+    allocator_counter_t counter = {.inner = &allocator};
+    rda_allocator counted = allocator_counter_wrap(&counter);
+    if (mem_stats) {
+      timers.counter = &counter;
+      timers.arena = &arena;
+    }
+    cache_t cache;
+    if (cache_dir && *cache_dir && !pipelined && !streamed) {
+      if (!cache_init(&cache, cache_dir, cache_size * 1024 * 1024)) return 1;
+      options.cache = &cache;
+    }
+    if (pipelined) {
+      char *file = rda_size(files) ? rda_at(files, 0) : "examples/variables.th";
+      if (!compile_file_pipelined(file, out_file)) return 1;
+    } else if (streamed) {
+      char *file = rda_size(files) ? rda_at(files, 0) : "examples/variables.th";
+      if (!compile_file_streamed(file, out_file)) return 1;
+    } else if (!batch) {
+      char *file = rda_size(files) ? rda_at(files, 0) : "examples/variables.th";
+      if (!compile_file(file, out_file, &options,
+                        mem_stats ? &counted : &allocator)) {
+        return 1;
+      }
+#ifdef DEBUG
+      arena_allocator_print(&arena);
+#endif  // DEBUG
+    } else if (out_file) {
+      fprintf(stderr, "Error: -o cannot be used when compiling several "
+              "files\n");
+      return 1;
+    } else if (!compile_files(rda_data(files), rda_size(files), &options,
+                              jobs)) {
+      return 1;
+    }
+    // Trimmed once per run, listing the cache after every file would cost
+    // more than a warm compile
+    if (options.cache && !options.timers) cache_evict(&cache, &allocator);
+    if (time_passes) timer_print(&timers, time_passes_json);
+    if (mem_stats) timer_print_memory(&timers, mem_stats_json);
   } else if (!strcmp(subcmd, "run")) {
-    assert(0 && "run subcommand is not implemented");
+    char *file = nullptr;
+    opt_level level = opt_level_1;
+    bool jit = false;
+    bool time_passes = false;
+    bool time_passes_json = false;
+    bool mem_stats = false;
+    bool mem_stats_json = false;
+    while (argc > 0) {
+      char *arg = utils_shift_args(&argc, &argv);
+      if (!strcmp(arg, "-O0")) {
+        level = opt_level_0;
+      } else if (!strcmp(arg, "-O1")) {
+        level = opt_level_1;
+      } else if (!strcmp(arg, "--jit")) {
+        jit = true;
+      } else if (!strcmp(arg, "--time-passes")) {
+        time_passes = true;
+      } else if (!strcmp(arg, "--time-passes=json")) {
+        time_passes = true;
+        time_passes_json = true;
+      } else if (!strcmp(arg, "--mem-stats")) {
+        mem_stats = true;
+      } else if (!strcmp(arg, "--mem-stats=json")) {
+        mem_stats = true;
+        mem_stats_json = true;
+      } else {
+        file = arg;
+      }
+    }
+    if (!file) file = "examples/variables.th";
+    timer_passes_t timer_totals = {};
+    timer_passes_t *timers =
+        time_passes || mem_stats ? &timer_totals : nullptr;
+    allocator_counter_t counter = {.inner = &allocator};
+    rda_allocator counted = allocator_counter_wrap(&counter);
+    if (mem_stats) {
+      timer_totals.counter = &counter;
+      timer_totals.arena = &arena;
+    }
+    parser_t parser;
+    if (!parser_init_with_allocator(&parser, file, 0, timers,
+                                    mem_stats ? &counted : &allocator)) {
+      return 1;
+    }
+    int status = 0;
+    uint64_t start = timer_start(timers);
+    bool success = parse(&parser);
+    timer_stop(timers, timer_parse, start,
+               tokens_size(&parser.tokenizer->tokens));
+    if (success) {
+      optimize(&parser.prg, &parser.tokenizer->symbols, parser.allocator,
+               level, timers);
+      size_t nodes = node_prg_size(&parser.prg);
+      if (jit) {
+        jit_program jit_prg;
+        start = timer_start(timers);
+        success = jit_compile(&jit_prg, &parser.prg,
+                              &parser.tokenizer->symbols, parser.allocator);
+        timer_stop(timers, timer_generate, start, nodes);
+        if (success) {
+          start = timer_start(timers);
+          success = jit_run(&jit_prg, &status, parser.allocator);
+          timer_stop(timers, timer_execute, start, 0);
+        }
+      } else {
+        vm_program vm_prg;
+        start = timer_start(timers);
+        success = vm_compile(&vm_prg, &parser.prg, &parser.tokenizer->symbols,
+                             parser.allocator);
+        timer_stop(timers, timer_generate, start, nodes);
+        if (success) {
+          start = timer_start(timers);
+          success = vm_run(&vm_prg, &status, parser.allocator);
+          timer_stop(timers, timer_execute, start, 0);
+        }
+      }
+    }
+    parser_deinit(&parser);
+    if (time_passes) timer_print(timers, time_passes_json);
+    if (mem_stats) timer_print_memory(timers, mem_stats_json);
+    if (!success) return 1;
+    // Like `exit()` in the generated C, only the low 8 bits reach the parent
+    return status;
   } else {
     help_msg(utils_shift_args_p(&argc, &argv), prg);
     fprintf(stderr, "Error: unknown subcommand %s\n", subcmd);
@@ -0,0 +1,142 @@
+#include "optimizer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "defines.h"
+#include "libraries/rit_dyn_arr.h"
+#include "parser.h"
+#include "symbols.h"
+#include "timer.h"
+
+/// @internal
+/// What the passes know about a variable, indexed by its symbol id.
+typedef struct {
+  int64_t value;  // Constant it holds, valid if `known`
+  uint32_t uses;  // Reads by the statements after the current one
+  bool known;
+} optimizer_var;
+
+/// @internal
+INTERNAL_DEF expr_idx optimizer_stmt_root(node_stmt *t_stmt) {
+  switch (t_stmt->type) {
+    case stmt_exit: {
+      return t_stmt->value.exit_stmt.status;
+    }
+    case stmt_var_decl: {
+      return t_stmt->value.var_decl_stmt.expr;
+    }
+  }
+  return 0;
+}
+
+/// @internal
+/// Folds the expression at `t_idx`. Its operands come earlier in the
+/// post-order pool, so they have already been folded as far as they go.
+INTERNAL_DEF void optimizer_fold_expr(node_prg *t_prg, optimizer_var *t_vars,
+                                      expr_idx t_idx) {
+  node_expr *expr = node_prg_expr(t_prg, t_idx);
+  switch (expr->type) {
+    case expr_num: {
+      break;
+    }
+    case expr_var: {
+      optimizer_var *var = &t_vars[expr->value.var_expr];
+      if (var->known) {
+        expr->type = expr_num;
+        expr->value.num_expr.value = var->value;
+      }
+      break;
+    }
+    case expr_bin: {
+      node_bin_expr bin = expr->value.bin_expr;
+      node_expr *lhs = node_prg_expr(t_prg, bin.lhs);
+      node_expr *rhs = node_prg_expr(t_prg, bin.rhs);
+      int64_t value;
+      if (lhs->type == expr_num && rhs->type == expr_num &&
+          node_bin_eval(bin.op, lhs->value.num_expr.value,
+                        rhs->value.num_expr.value, &value)) {
+        // The operands are left behind in the pool, unreferenced
+        expr->type = expr_num;
+        expr->value.num_expr.value = value;
+      }
+      break;
+    }
+  }
+}
+
+/// @internal
+/// Walks the statements in order, folding each statement's expressions and
+/// recording the constant held by each variable for the statements after it.
+INTERNAL_DEF void optimizer_fold(node_prg *t_prg, optimizer_var *t_vars) {
+  expr_idx begin = 0;
+  rda_for_each(it, t_prg->stmts) {
+    expr_idx root = optimizer_stmt_root(it);
+    for (expr_idx idx = begin; idx <= root; ++idx) {
+      optimizer_fold_expr(t_prg, t_vars, idx);
+    }
+    begin = root + 1;
+    if (it->type == stmt_var_decl) {
+      node_expr *expr = node_prg_expr(t_prg, root);
+      optimizer_var *var = &t_vars[it->value.var_decl_stmt.name];
+      var->known = expr->type == expr_num;
+      // Variables are generated as C `int`s, so they hold the truncated value
+      if (var->known) var->value = (int32_t)expr->value.num_expr.value;
+    }
+  }
+}
+
+/// @internal
+/// Walks the statements backwards, counting the variable reads of every
+/// statement that is kept, and drops declarations with no reads after them.
+INTERNAL_DEF void optimizer_drop_dead_decls(node_prg *t_prg,
+                                            optimizer_var *t_vars) {
+  node_stmt *stmts = rda_data(t_prg->stmts);
+  size_t stmts_len = rda_size(t_prg->stmts);
+  size_t kept = stmts_len;
+  for (size_t i = stmts_len; i-- > 0;) {
+    node_stmt stmt = stmts[i];
+    expr_idx begin = i == 0 ? 0 : optimizer_stmt_root(&stmts[i - 1]) + 1;
+    expr_idx root = optimizer_stmt_root(&stmt);
+    bool can_trap = false;
+    for (expr_idx idx = begin; idx <= root; ++idx) {
+      node_expr *expr = node_prg_expr(t_prg, idx);
+      if (expr->type == expr_bin && expr->value.bin_expr.op == token_fslash) {
+        can_trap = true;
+      }
+    }
+    if (stmt.type == stmt_var_decl) {
+      optimizer_var *var = &t_vars[stmt.value.var_decl_stmt.name];
+      bool live = var->uses > 0 || can_trap;
+      // Reads before this statement refer to an earlier declaration
+      var->uses = 0;
+      if (!live) continue;
+    }
+    for (expr_idx idx = begin; idx <= root; ++idx) {
+      node_expr *expr = node_prg_expr(t_prg, idx);
+      if (expr->type == expr_var) t_vars[expr->value.var_expr].uses++;
+    }
+    // Kept statements are packed at the end, in their original order
+    stmts[--kept] = stmt;
+  }
+  memmove(stmts, stmts + kept, (stmts_len - kept) * sizeof(node_stmt));
+  t_prg->stmts.m_size = stmts_len - kept;
+}
+
+void optimize(node_prg *t_prg, symbols_t *t_symbols,
+              rda_allocator *t_allocator, opt_level t_level,
+              timer_passes_t *t_timers) {
+  if (t_level == opt_level_0) return;
+
+  size_t nodes = node_prg_size(t_prg);
+  uint64_t start = timer_start(t_timers);
+  size_t vars_size = symbols_size(t_symbols) * sizeof(optimizer_var);
+  optimizer_var *vars = t_allocator->alloc(t_allocator->m_ctx, vars_size);
+  memset(vars, 0, vars_size);
+  optimizer_fold(t_prg, vars);
+  timer_stop(t_timers, timer_fold, start, nodes);
+  start = timer_start(t_timers);
+  optimizer_drop_dead_decls(t_prg, vars);
+  timer_stop(t_timers, timer_dead_decls, start, nodes);
+}
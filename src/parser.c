@@ -4,82 +4,142 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "allocator.h"
 #include "defines.h"
-#include "generator.h"
-#include "libraries/arena_allocator.h"
 #include "libraries/rit_dyn_arr.h"
 #include "libraries/rit_str.h"
+#include "timer.h"
 #include "tokenizer.h"
+#include "utils.h"
 
-parser_t parser_init(const char *t_file) {
-  Arena *arena = malloc(sizeof(Arena));
-  arena->m_begin = nullptr;
-  arena->m_active = nullptr;
+bool parser_init(parser_t *t_parser, const char *t_file) {
+  arena_allocator_t *arena = calloc(1, sizeof(arena_allocator_t));
   rda_allocator *allocator = malloc(sizeof(rstr_allocator));
   allocator->alloc = arena_allocator_alloc;
   allocator->free = arena_allocator_free;
   allocator->realloc = arena_allocator_realloc;
   allocator->m_ctx = arena;
 
+  if (!parser_init_with_allocator(t_parser, t_file, 0, nullptr, allocator)) {
+    arena_allocator_free(arena, nullptr);
+    free(arena);
+    free(allocator);
+    return false;
+  }
+  t_parser->owns_allocator = true;
+  return true;
+}
+
+bool parser_init_with_allocator(parser_t *t_parser, const char *t_file,
+                                size_t t_lex_jobs, timer_passes_t *t_timers,
+                                rda_allocator *t_allocator) {
+  uint64_t start = timer_start(t_timers);
   tokenizer_t *tokenizer =
-      (tokenizer_t *)arena_alloc(allocator->m_ctx, sizeof(tokenizer_t));
-  *tokenizer = tokenizer_init(t_file, allocator);
-  tokenize(tokenizer);
+      t_allocator->alloc(t_allocator->m_ctx, sizeof(tokenizer_t));
+  if (!tokenizer_init(tokenizer, t_file, t_allocator)) return false;
+  size_t size = rsv_size(tokenizer->buffer);
+  timer_stop(t_timers, timer_read, start, size);
+  start = timer_start(t_timers);
+  if (t_lex_jobs > 1) {
+    tokenize_parallel(tokenizer, t_lex_jobs);
+  } else {
+    tokenize(tokenizer);
+  }
+  timer_stop(t_timers, timer_lex, start, size);
+
+  parser_t ret = {.prg = {},
+                  .expr_frames = {},
+                  .tokenizer = tokenizer,
+                  .allocator = t_allocator,
+                  .owns_allocator = false};
+  // Every expression takes at least one token and every statement four, so
+  // pools sized from the token count never grow. Where pages are committed
+  // lazily, the part that is never used costs no memory. This counts as
+  // parsing.
+  start = timer_start(t_timers);
+  size_t tokens_len = tokens_size(&tokenizer->tokens);
+  rda_init(ret.prg.exprs, tokens_len / 2 + 1, sizeof(node_expr), t_allocator);
+  rda_init(ret.prg.stmts, tokens_len / 8 + 1, sizeof(node_stmt), t_allocator);
+  ret.prg.exprs.m_size = 0;
+  ret.prg.stmts.m_size = 0;
+  rda_init(ret.expr_frames, 0, sizeof(parser_expr_frame), t_allocator);
+  timer_stop(t_timers, timer_parse, start, 0);
+
+  *t_parser = ret;
+  return true;
+}
 
-  parser_t ret = {.prg = {}, .tokenizer = tokenizer, .allocator = allocator};
-  rda_init(ret.prg, 0, sizeof(node_stmt), allocator);
+void node_prg_init(node_prg *t_prg, rda_allocator *t_allocator) {
+  rda_init(t_prg->exprs, 0, sizeof(node_expr), t_allocator);
+  rda_init(t_prg->stmts, 0, sizeof(node_stmt), t_allocator);
+}
 
-  return ret;
+/// @internal
+INTERNAL_DEF expr_idx parser_push_expr(parser_t *t_parser, node_expr t_expr) {
+  rda_push_back(t_parser->prg.exprs, t_expr, t_parser->allocator);
+  return (expr_idx)(rda_size(t_parser->prg.exprs) - 1);
 }
 
-INTERNAL_DEF token_t parser_peek(parser_t *t_parser, int64_t t_offset) {
-  return rda_at(t_parser->tokenizer->tokens, t_parser->idx + t_offset);
+INTERNAL_DEF token_type parser_peek(parser_t *t_parser, int64_t t_offset) {
+  return tokenizer_token_type(t_parser->tokenizer, t_parser->idx + t_offset);
 }
 
-INTERNAL_DEF token_t parser_consume(parser_t *t_parser) {
-  token_t tok = rda_at(t_parser->tokenizer->tokens, t_parser->idx);
-  t_parser->idx++;
-  return tok;
+/// @internal
+/// Returns the index of the consumed token, use `tokenizer_token_value()` to
+/// get its text.
+INTERNAL_DEF size_t parser_consume(parser_t *t_parser) {
+  return t_parser->idx++;
 }
 
-#define TOK_LINE parser_peek(t_parser, -1).line
-#define TOK_COL \
-  parser_peek(t_parser, -1).col + rsv_size(parser_peek(t_parser, -1).value)
+/// @internal
+/// Location just past the previously consumed token, used for diagnostics.
+INTERNAL_DEF token_loc_t parser_prev_loc(parser_t *t_parser) {
+  size_t prev = t_parser->idx - 1;
+  token_loc_t loc = tokenizer_token_loc(t_parser->tokenizer, prev);
+  loc.col += rda_at(t_parser->tokenizer->tokens.lens, prev);
+  return loc;
+}
+
+INTERNAL_DEF bool parser_at_stmt_end(parser_t *t_parser) {
+  token_type type = parser_peek(t_parser, 0);
+  return type == token_semicolon || type == token_newline || type == token_eof;
+}
+
+/// @internal
+/// Consumes the semicolon or newline that ends a statement. The end of file
+/// also ends a statement, but it is never consumed.
+INTERNAL_DEF void parser_consume_stmt_end(parser_t *t_parser) {
+  if (parser_peek(t_parser, 0) != token_eof) parser_consume(t_parser);
+}
 
 INTERNAL_DEF void parser_skip_statement(parser_t *t_parser) {
-  while (parser_peek(t_parser, 0).type != token_semicolon &&
-         parser_peek(t_parser, 0).type != token_newline) {
+  while (!parser_at_stmt_end(t_parser)) {
     parser_consume(t_parser);
   }
-  parser_consume(t_parser);
+  parser_consume_stmt_end(t_parser);
 }
 
-INTERNAL_DEF token_t parser_try_consume(parser_t *t_parser,
-                                        token_type t_token_type) {
-  if (parser_peek(t_parser, 0).type != t_token_type) {
-    return (token_t){.type = token_invalid,
-                     .value = {.m_size = 0, .m_str = ""},
-                     .line = parser_peek(t_parser, 0).line,
-                     .col = parser_peek(t_parser, 0).col};
+INTERNAL_DEF token_type parser_try_consume(parser_t *t_parser,
+                                           token_type t_token_type) {
+  if (parser_peek(t_parser, 0) != t_token_type) {
+    return token_invalid;
   }
-  return parser_consume(t_parser);
+  parser_consume(t_parser);
+  return t_token_type;
 }
 
-INTERNAL_DEF token_t parser_expected_consume(parser_t *t_parser,
-                                             token_type t_token_type) {
-  token_t tok = parser_try_consume(t_parser, t_token_type);
-  if (tok.type == token_invalid) {
-    fprintf(stderr, "Error:%zu:%zu: expected %s\n", TOK_LINE, TOK_COL,
+INTERNAL_DEF token_type parser_expected_consume(parser_t *t_parser,
+                                                token_type t_token_type) {
+  if (parser_try_consume(t_parser, t_token_type) == token_invalid) {
+    token_loc_t loc = parser_prev_loc(t_parser);
+    fprintf(stderr, "Error:%zu:%zu: expected %s\n", loc.line, loc.col,
             token_type_to_str(t_token_type));
     parser_skip_statement(t_parser);
-    return (token_t){.type = token_error,
-                     .value = {.m_size = 0, .m_str = ""},
-                     .line = parser_peek(t_parser, 0).line,
-                     .col = parser_peek(t_parser, 0).col};
+    return token_error;
   }
-  return tok;
+  return t_token_type;
 }
 
 INTERNAL_DEF binding_power binding_power_lookup(token_type t_token_type) {
@@ -87,13 +147,11 @@ INTERNAL_DEF binding_power binding_power_lookup(token_type t_token_type) {
     case token_num:
       return bp_primary;
     case token_plus:
-      return bp_add;
     case token_minus:
-      return bp_sub;
+      return bp_sum;
     case token_star:
-      return bp_mul;
     case token_fslash:
-      return bp_div;
+      return bp_product;
     default: {
       return bp_default;
     }
@@ -101,64 +159,82 @@ INTERNAL_DEF binding_power binding_power_lookup(token_type t_token_type) {
 }
 
 #ifdef DEBUG
-INTERNAL_DEF void print_expr(const char *t_prefix, node_expr *t_expr) {
-  switch (t_expr->type) {
-    case expr_num: {
-      printf("[DEBUG] %s: %" PRId64 "\n", t_prefix,
-             t_expr->value.num_expr.value);
-      break;
-    }
-    case expr_var: {
-      printf("[DEBUG] %s: %s\n", t_prefix, rsv_get(t_expr->value.var_expr));
-      break;
-    }
-    case expr_bin: {
+/// @internal
+/// Prints the expression in-order, using an explicit stack so deep
+/// expressions do not overflow the call stack. Subtrees whose path does not
+/// fit in the prefix buffer are elided.
+INTERNAL_DEF void print_expr(parser_t *t_parser, const char *t_prefix,
+                             expr_idx t_idx) {
 #define PREFIX_SZ 64
-      char prefix[PREFIX_SZ];
-      int written_chars = snprintf(prefix, PREFIX_SZ, "%s.lhs", t_prefix);
-      if (written_chars >= PREFIX_SZ) {
-        fprintf(stderr,
-                "[DEBUG] Error: prefix needs to be a bigger buffer, file: %s, "
-                "line: %u",
-                __FILE__, __LINE__);
-        exit(1);
-      }
-      print_expr(prefix, t_expr->value.bin_expr.lhs);
-
-      printf("[DEBUG] %s.op: %s\n", t_prefix,
-             token_type_to_str(t_expr->value.bin_expr.op));
+  char prefix[PREFIX_SZ];
+  snprintf(prefix, PREFIX_SZ, "%s", t_prefix);
+  typedef struct {
+    expr_idx idx;
+    size_t prefix_len;
+    bool lhs_done;
+  } print_frame;
+  rda(print_frame, stack, 0, t_parser->allocator);
+  print_frame root = {.idx = t_idx, .prefix_len = strlen(prefix)};
+  rda_push_back(stack, root, t_parser->allocator);
 
-      written_chars = snprintf(prefix, PREFIX_SZ, "%s.rhs", t_prefix);
-      if (written_chars >= PREFIX_SZ) {
-        fprintf(stderr,
-                "[DEBUG] Error: prefix needs to be a bigger buffer, file: %s, "
-                "line: %u",
-                __FILE__, __LINE__);
-        exit(1);
+  while (rda_size(stack) > 0) {
+    print_frame frame = rda_at(stack, rda_size(stack) - 1);
+    stack.m_size--;
+    prefix[frame.prefix_len] = '\0';
+    node_expr *expr = node_prg_expr(&t_parser->prg, frame.idx);
+    switch (expr->type) {
+      case expr_num: {
+        printf("[DEBUG] %s: %" PRId64 "\n", prefix, expr->value.num_expr.value);
+        break;
+      }
+      case expr_var: {
+        rsv name =
+            symbols_name(&t_parser->tokenizer->symbols, expr->value.var_expr);
+        printf("[DEBUG] %s: %.*s\n", prefix, (int)rsv_size(name),
+               rsv_get(name));
+        break;
+      }
+      case expr_bin: {
+        if (frame.prefix_len + sizeof(".lhs") > PREFIX_SZ) {
+          printf("[DEBUG] %s: <too deep to print>\n", prefix);
+          break;
+        }
+        if (frame.lhs_done) {
+          printf("[DEBUG] %s.op: %s\n", prefix,
+                 token_type_to_str(expr->value.bin_expr.op));
+          print_frame rhs = {.idx = expr->value.bin_expr.rhs,
+                             .prefix_len = frame.prefix_len + 4};
+          rda_push_back(stack, rhs, t_parser->allocator);
+          memcpy(prefix + frame.prefix_len, ".rhs", sizeof(".rhs"));
+        } else {
+          frame.lhs_done = true;
+          rda_push_back(stack, frame, t_parser->allocator);
+          print_frame lhs = {.idx = expr->value.bin_expr.lhs,
+                             .prefix_len = frame.prefix_len + 4};
+          rda_push_back(stack, lhs, t_parser->allocator);
+          memcpy(prefix + frame.prefix_len, ".lhs", sizeof(".lhs"));
+        }
+        break;
       }
-      print_expr(prefix, t_expr->value.bin_expr.rhs);
-      break;
     }
   }
+#undef PREFIX_SZ
 }
 #endif  // DEBUG
 
-INTERNAL_DEF node_expr *parse_primary_expr(parser_t *t_parser) {
-  // token_t tok = parser_expected_consume(t_parser, token_num);
-  node_expr *expr = arena_alloc_struct(t_parser->allocator->m_ctx, node_expr);
-  switch (parser_peek(t_parser, 0).type) {
+INTERNAL_DEF expr_idx parse_primary_expr(parser_t *t_parser) {
+  node_expr expr = {.value = {.num_expr = {.value = 0}}, .type = expr_num};
+  switch (parser_peek(t_parser, 0)) {
     case token_num: {
-      token_t tok = parser_consume(t_parser);
-      node_num_expr num_expr = {.value = atoi(rsv_get(tok.value))};
-      expr->type = expr_num;
-      expr->value.num_expr = num_expr;
+      rsv value = tokenizer_token_value(t_parser->tokenizer,
+                                        parser_consume(t_parser));
+      expr.value.num_expr.value = utils_rsv_to_int64(value);
       break;
     }
     case token_ident: {
-      token_t tok = parser_consume(t_parser);
-      rsv var_expr = tok.value;
-      expr->type = expr_var;
-      expr->value.var_expr = var_expr;
+      expr.type = expr_var;
+      expr.value.var_expr = tokenizer_token_symbol(t_parser->tokenizer,
+                                                   parser_consume(t_parser));
       break;
     }
     default: {
@@ -166,134 +242,151 @@ INTERNAL_DEF node_expr *parse_primary_expr(parser_t *t_parser) {
       break;
     }
   }
-  // if (tok.type == token_error) exit(1);
-  return expr;
+  return parser_push_expr(t_parser, expr);
 }
 
-// Forward declare because `parse_bin_expr()` and `parse_expr()` rely on each
-// other.
-INTERNAL_DEF node_expr *parse_expr(parser_t *t_parser,
-                                   binding_power t_binding_power);
-
-INTERNAL_DEF node_expr *parse_bin_expr(parser_t *t_parser, node_expr *t_lhs) {
-  node_expr *expr = arena_alloc_struct(t_parser->allocator->m_ctx, node_expr);
-  expr->type = expr_bin;
-  expr->value.bin_expr.lhs = t_lhs;
-  expr->value.bin_expr.op = parser_consume(t_parser).type;
-  expr->value.bin_expr.rhs =
-      parse_expr(t_parser, binding_power_lookup(expr->value.bin_expr.op));
-  return expr;
-}
+/// @internal
+/// Pratt parser driven by an explicit stack instead of recursion, so
+/// machine-generated expressions with millions of operators neither overflow
+/// nor thrash the call stack. Each frame is a binary expression still waiting
+/// for its right operand, along with the binding power of the enclosing
+/// expression to restore once it is complete.
+INTERNAL_DEF expr_idx parse_expr(parser_t *t_parser) {
+  t_parser->expr_frames.m_size = 0;
+  binding_power min_bp = bp_default;
+  expr_idx lhs = parse_primary_expr(t_parser);
+  while (true) {
+    token_type op = parser_peek(t_parser, 0);
+    if (binding_power_lookup(op) > min_bp) {
+      parser_consume(t_parser);
+      parser_expr_frame frame = {.lhs = lhs, .op = op, .min_bp = min_bp};
+      rda_push_back(t_parser->expr_frames, frame, t_parser->allocator);
+      min_bp = binding_power_lookup(op);
+      lhs = parse_primary_expr(t_parser);
+      continue;
+    }
+    if (rda_size(t_parser->expr_frames) == 0) break;
 
-INTERNAL_DEF node_expr *parse_expr(parser_t *t_parser,
-                                   binding_power t_binding_power) {
-  node_expr *expr = parse_primary_expr(t_parser);
-  while (binding_power_lookup(parser_peek(t_parser, 0).type) >
-         t_binding_power) {
-    expr = parse_bin_expr(t_parser, expr);
+    // `lhs` is the finished right operand of the innermost frame. The node is
+    // pushed after both operands, which keeps the pool in post-order.
+    parser_expr_frame frame =
+        rda_at(t_parser->expr_frames, rda_size(t_parser->expr_frames) - 1);
+    t_parser->expr_frames.m_size--;
+    node_expr expr = {
+        .value = {.bin_expr = {.lhs = frame.lhs, .rhs = lhs, .op = frame.op}},
+        .type = expr_bin};
+    lhs = parser_push_expr(t_parser, expr);
+    min_bp = frame.min_bp;
   }
-  return expr;
+  return lhs;
 }
 
 INTERNAL_DEF bool parse_stmt_exit(parser_t *t_parser) {
-  if (parser_expected_consume(t_parser, token_open_paren).type == token_error) {
+  if (parser_expected_consume(t_parser, token_open_paren) == token_error) {
     return false;
   }
-  node_expr *expr = parse_expr(t_parser, bp_default);
-  if (parser_expected_consume(t_parser, token_close_paren).type ==
-      token_error) {
+  expr_idx expr = parse_expr(t_parser);
+  if (parser_expected_consume(t_parser, token_close_paren) == token_error) {
     return false;
   }
-  if (parser_peek(t_parser, 0).type != token_semicolon &&
-      parser_peek(t_parser, 0).type != token_newline) {
-    fprintf(stderr, "Error:%zu:%zu: expected a newline or ;\n", TOK_LINE,
-            TOK_COL);
+  if (!parser_at_stmt_end(t_parser)) {
+    token_loc_t loc = parser_prev_loc(t_parser);
+    fprintf(stderr, "Error:%zu:%zu: expected a newline or ;\n", loc.line,
+            loc.col);
     return false;
   }
-  parser_consume(t_parser);  // Consume the semicolon or newline
+  parser_consume_stmt_end(t_parser);
   node_stmt stmt;
   stmt.type = stmt_exit;
   stmt.value.exit_stmt.status = expr;
-  rda_push_back(t_parser->prg, stmt, t_parser->allocator);
+  rda_push_back(t_parser->prg.stmts, stmt, t_parser->allocator);
   return true;
 }
 
 INTERNAL_DEF bool parse_stmt_var_decl(parser_t *t_parser,
-                                      token_t t_token_ident) {
-  if (parser_expected_consume(t_parser, token_colon).type == token_error) {
+                                      size_t t_token_ident) {
+  if (parser_expected_consume(t_parser, token_colon) == token_error) {
     return false;
   }
-  if (parser_expected_consume(t_parser, token_assignment).type == token_error) {
+  if (parser_expected_consume(t_parser, token_assignment) == token_error) {
     return false;
   }
-  node_expr *expr = parse_expr(t_parser, bp_default);
-  if (parser_peek(t_parser, 0).type != token_semicolon &&
-      parser_peek(t_parser, 0).type != token_newline) {
-    fprintf(stderr, "Error:%zu:%zu: expected a newline or ;\n", TOK_LINE,
-            TOK_COL);
+  expr_idx expr = parse_expr(t_parser);
+  if (!parser_at_stmt_end(t_parser)) {
+    token_loc_t loc = parser_prev_loc(t_parser);
+    fprintf(stderr, "Error:%zu:%zu: expected a newline or ;\n", loc.line,
+            loc.col);
     return false;
   }
-  parser_consume(t_parser);  // Consume the semicolon or newline
+  parser_consume_stmt_end(t_parser);
   node_stmt stmt;
   stmt.type = stmt_var_decl;
-  stmt.value.var_decl_stmt.name = t_token_ident.value;
+  stmt.value.var_decl_stmt.name =
+      tokenizer_token_symbol(t_parser->tokenizer, t_token_ident);
   stmt.value.var_decl_stmt.expr = expr;
-  rda_push_back(t_parser->prg, stmt, t_parser->allocator);
+  rda_push_back(t_parser->prg.stmts, stmt, t_parser->allocator);
   return true;
 }
 
 INTERNAL_DEF bool parse_stmt(parser_t *t_parser) {
-  if (parser_peek(t_parser, 0).type == token_newline ||
-      parser_peek(t_parser, 0).type == token_semicolon) {
+  if (parser_peek(t_parser, 0) == token_newline ||
+      parser_peek(t_parser, 0) == token_semicolon) {
     parser_consume(t_parser);
     return true;
-  } else if (parser_try_consume(t_parser, token_exit).type != token_invalid) {
+  } else if (parser_try_consume(t_parser, token_exit) != token_invalid) {
     return parse_stmt_exit(t_parser);
-  } else if (parser_peek(t_parser, 0).type == token_ident) {
+  } else if (parser_peek(t_parser, 0) == token_ident) {
     return parse_stmt_var_decl(t_parser, parser_consume(t_parser));
-  } else if (parser_try_consume(t_parser, token_fslash).type != token_invalid &&
-             parser_try_consume(t_parser, token_fslash).type != token_invalid) {
-    while (parser_peek(t_parser, 0).type != token_newline) {
+  } else if (parser_try_consume(t_parser, token_fslash) != token_invalid &&
+             parser_try_consume(t_parser, token_fslash) != token_invalid) {
+    while (parser_peek(t_parser, 0) != token_newline &&
+           parser_peek(t_parser, 0) != token_eof) {
       parser_consume(t_parser);
     }
-    parser_consume(t_parser);
+    parser_consume_stmt_end(t_parser);
     return true;
   } else {
-    fprintf(stderr, "Error:%zu:%zu: invalid identifier %s\n",
-            parser_peek(t_parser, 0).line, parser_peek(t_parser, 0).col,
-            rsv_get(parser_peek(t_parser, 0).value));
+    token_loc_t loc = tokenizer_token_loc(t_parser->tokenizer, t_parser->idx);
+    rsv value = tokenizer_token_value(t_parser->tokenizer, t_parser->idx);
+    fprintf(stderr, "Error:%zu:%zu: invalid identifier %.*s\n", loc.line,
+            loc.col, (int)rsv_size(value), rsv_get(value));
     parser_skip_statement(t_parser);
     return false;
   }
 }
 
-void parse(parser_t *t_parser) {
+bool parse(parser_t *t_parser) {
   bool success = true;
-  while (t_parser->idx < rda_size(t_parser->tokenizer->tokens)) {
+  while (parser_peek(t_parser, 0) != token_eof) {
     success = parse_stmt(t_parser) ? success : false;
   }
 
 #ifdef DEBUG
-  rda_for_each(it, t_parser->prg) {
+  rda_for_each(it, t_parser->prg.stmts) {
     switch (it->type) {
       case stmt_exit: {
-        print_expr("stmt_exit.status", it->value.exit_stmt.status);
+        print_expr(t_parser, "stmt_exit.status", it->value.exit_stmt.status);
         break;
       }
       case stmt_var_decl: {
-        printf("[DEBUG] stmt_var_decl.name: %s\n",
-               rsv_get(it->value.var_decl_stmt.name));
-        print_expr("stmt_var_decl.expr", it->value.var_decl_stmt.expr);
+        rsv name = symbols_name(&t_parser->tokenizer->symbols,
+                                it->value.var_decl_stmt.name);
+        printf("[DEBUG] stmt_var_decl.name: %.*s\n", (int)rsv_size(name),
+               rsv_get(name));
+        print_expr(t_parser, "stmt_var_decl.expr",
+                   it->value.var_decl_stmt.expr);
         break;
       }
     }
   }
 #endif  // DEBUG
 
-  if (success) generate(nullptr, &(t_parser->prg));
+  return success;
 }
 
 void parser_deinit(parser_t *t_parser) {
+  tokenizer_deinit(t_parser->tokenizer);
+  if (!t_parser->owns_allocator) return;
   arena_allocator_free(t_parser->allocator->m_ctx, nullptr);
   free(t_parser->allocator->m_ctx);
   t_parser->allocator->m_ctx = nullptr;
@@ -0,0 +1,216 @@
+#include "pipeline.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "allocator.h"
+#include "defines.h"
+#include "generator.h"
+#include "libraries/rit_dyn_arr.h"
+#include "libraries/rit_str.h"
+#include "parser.h"
+#include "symbols.h"
+#include "thread.h"
+#include "tokenizer.h"
+
+/// Source bytes lexed per batch, small enough that the stages start working
+/// on a file almost immediately
+#define PIPELINE_BATCH_SIZE (64 * 1024)
+/// Batches in flight between two stages, a power of two
+#define PIPELINE_RING_LEN 8
+
+typedef rda_struct(rsv) pipeline_names_t;
+
+/// @internal
+/// A batch of tokens, from the lexer to the parser. Only the lexer reads the
+/// symbol table it interns into, so the names of the symbols first seen in
+/// the batch travel with it, in id order.
+typedef struct {
+  tokenizer_t tokenizer;  // The lexer's state right after the batch
+  pipeline_names_t names;
+  bool last;
+} pipeline_tokens;
+
+/// @internal
+/// A batch of statements, from the parser to the generator.
+typedef struct {
+  node_prg prg;
+  pipeline_names_t names;
+  bool last;
+  bool failed;  // Whether this batch or one before it failed to parse
+} pipeline_stmts;
+
+/// @internal
+/// Every stage allocates from an arena of its own, and only reads what the
+/// previous stage published through a ring.
+typedef struct {
+  tokenizer_t lexer;
+  pipeline_tokens tokens[PIPELINE_RING_LEN];
+  thread_ring tokens_ring;
+  pipeline_stmts stmts[PIPELINE_RING_LEN];
+  thread_ring stmts_ring;
+  arena_allocator_t lexer_arena;
+  arena_allocator_t parser_arena;
+  arena_allocator_t generator_arena;
+  rda_allocator lexer_allocator;
+  rda_allocator parser_allocator;
+  rda_allocator generator_allocator;
+  const char *out_file;
+  bool success;
+} pipeline_t;
+
+/// @internal
+INTERNAL_DEF void pipeline_lex(pipeline_t *t_pipeline) {
+  tokenizer_t *lexer = &t_pipeline->lexer;
+  size_t names_sent = symbols_size(&lexer->symbols);
+  bool more = true;
+  while (more) {
+    pipeline_tokens *batch =
+        &t_pipeline->tokens[thread_ring_reserve(&t_pipeline->tokens_ring)];
+    // Lex into the arrays the slot had on its previous lap
+    lexer->tokens = batch->tokenizer.tokens;
+    lexer->newlines = batch->tokenizer.newlines;
+    lexer->errors = batch->tokenizer.errors;
+    more = tokenize_batch(lexer, PIPELINE_BATCH_SIZE);
+    batch->tokenizer = *lexer;
+    batch->names.m_size = 0;
+    for (; names_sent < symbols_size(&lexer->symbols); ++names_sent) {
+      rda_push_back(batch->names,
+                    symbols_name(&lexer->symbols, (symbol_id)names_sent),
+                    &t_pipeline->lexer_allocator);
+    }
+    batch->last = !more;
+    // The next batch starts on the line after this one's last newline
+    size_t newlines_len = rda_size(lexer->newlines);
+    if (newlines_len > 0) {
+      lexer->line_base += newlines_len;
+      lexer->line_base_offset = rda_at(lexer->newlines, newlines_len - 1) + 1;
+    }
+    thread_ring_push(&t_pipeline->tokens_ring);
+  }
+}
+
+/// @internal
+INTERNAL_DEF void pipeline_parse(void *t_pipeline) {
+  pipeline_t *pipeline = t_pipeline;
+  rda_allocator *allocator = &pipeline->parser_allocator;
+  symbols_t names;
+  symbols_init(&names, allocator);
+  parser_t parser = {.idx = 0,
+                     .prg = {},
+                     .expr_frames = {},
+                     .allocator = allocator,
+                     .owns_allocator = false,
+                     .tokenizer = nullptr};
+  rda_init(parser.expr_frames, 0, sizeof(parser_expr_frame), allocator);
+  bool failed = false;
+  bool last = false;
+  while (!last) {
+    pipeline_tokens *in =
+        &pipeline->tokens[thread_ring_peek(&pipeline->tokens_ring)];
+    pipeline_stmts *out =
+        &pipeline->stmts[thread_ring_reserve(&pipeline->stmts_ring)];
+    out->names.m_size = 0;
+    rda_for_each(it, in->names) {
+      symbols_push_name(&names, *it);
+      rda_push_back(out->names, *it, allocator);
+    }
+    tokenizer_t tokenizer = in->tokenizer;
+    tokenizer.symbols = names;
+    // Parse straight into the slot's pools, reusing their memory
+    node_prg_reset(&out->prg);
+    parser.prg = out->prg;
+    parser.idx = 0;
+    parser.tokenizer = &tokenizer;
+    failed = !parse(&parser) || failed;
+    out->prg = parser.prg;
+    last = in->last;
+    thread_ring_pop(&pipeline->tokens_ring);
+
+    out->last = last;
+    out->failed = failed;
+    thread_ring_push(&pipeline->stmts_ring);
+  }
+}
+
+/// @internal
+INTERNAL_DEF void pipeline_generate(void *t_pipeline) {
+  pipeline_t *pipeline = t_pipeline;
+  rda_allocator *allocator = &pipeline->generator_allocator;
+  symbols_t names;
+  symbols_init(&names, allocator);
+  generator_t gen;
+  // The C is usually about as big as the source
+  generator_init(&gen, rsv_size(pipeline->lexer.buffer) + 64, &names,
+                 allocator);
+  bool failed = false;
+  bool last = false;
+  while (!last) {
+    pipeline_stmts *in =
+        &pipeline->stmts[thread_ring_peek(&pipeline->stmts_ring)];
+    rda_for_each(it, in->names) { symbols_push_name(&names, *it); }
+    failed = in->failed;
+    // Nothing is written once a statement failed to parse
+    if (!failed) generate_stmts(&gen, &in->prg);
+    last = in->last;
+    thread_ring_pop(&pipeline->stmts_ring);
+  }
+  pipeline->success = !failed && generator_finish(&gen, pipeline->out_file);
+}
+
+bool compile_file_pipelined(const char *t_file, const char *t_out_file) {
+  pipeline_t *pipeline = calloc(1, sizeof(pipeline_t));
+  pipeline->lexer_allocator =
+      (rda_allocator){arena_allocator_alloc, arena_allocator_free,
+                       arena_allocator_realloc, &pipeline->lexer_arena};
+  pipeline->parser_allocator =
+      (rda_allocator){arena_allocator_alloc, arena_allocator_free,
+                       arena_allocator_realloc, &pipeline->parser_arena};
+  pipeline->generator_allocator =
+      (rda_allocator){arena_allocator_alloc, arena_allocator_free,
+                       arena_allocator_realloc, &pipeline->generator_arena};
+  pipeline->tokens_ring.len = PIPELINE_RING_LEN;
+  pipeline->stmts_ring.len = PIPELINE_RING_LEN;
+  pipeline->out_file = t_out_file;
+  if (!tokenizer_init(&pipeline->lexer, t_file, &pipeline->lexer_allocator)) {
+    arena_allocator_free(&pipeline->lexer_arena, nullptr);
+    free(pipeline);
+    return false;
+  }
+  for (size_t i = 0; i < PIPELINE_RING_LEN; ++i) {
+    // Each side only grows the slots with its own allocator
+    tokenizer_t *tokenizer = &pipeline->tokens[i].tokenizer;
+    rda_allocator *lexer_allocator = &pipeline->lexer_allocator;
+    rda_init(tokenizer->tokens.kinds, 0, sizeof(uint8_t), lexer_allocator);
+    rda_init(tokenizer->tokens.offsets, 0, sizeof(uint32_t), lexer_allocator);
+    rda_init(tokenizer->tokens.lens, 0, sizeof(uint32_t), lexer_allocator);
+    rda_init(tokenizer->tokens.syms, 0, sizeof(uint32_t), lexer_allocator);
+    rda_init(tokenizer->newlines, 0, sizeof(uint32_t), lexer_allocator);
+    rda_init(tokenizer->errors, 0, sizeof(uint32_t), lexer_allocator);
+    rda_init(pipeline->tokens[i].names, 0, sizeof(rsv), lexer_allocator);
+    node_prg_init(&pipeline->stmts[i].prg, &pipeline->parser_allocator);
+    rda_init(pipeline->stmts[i].names, 0, sizeof(rsv),
+             &pipeline->parser_allocator);
+  }
+
+  // Every stage blocks on the next one once a ring is full, so all three must
+  // be running
+  thread_t parser_thread;
+  thread_t generator_thread;
+  if (!thread_create(&generator_thread, pipeline_generate, pipeline) ||
+      !thread_create(&parser_thread, pipeline_parse, pipeline)) {
+    exit(1);
+  }
+  pipeline_lex(pipeline);
+  thread_join(parser_thread);
+  thread_join(generator_thread);
+
+  bool success = pipeline->success;
+  tokenizer_deinit(&pipeline->lexer);
+  arena_allocator_free(&pipeline->lexer_arena, nullptr);
+  arena_allocator_free(&pipeline->parser_arena, nullptr);
+  arena_allocator_free(&pipeline->generator_arena, nullptr);
+  free(pipeline);
+  return success;
+}
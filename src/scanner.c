@@ -0,0 +1,196 @@
+#include "scanner.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "defines.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define SCANNER_SSE2
+#include <emmintrin.h>
+#endif
+
+// MSVC accepts AVX2 intrinsics without a target attribute, but has no cheap
+// equivalent of `__builtin_cpu_supports()`, so it sticks to SSE2.
+#if defined(SCANNER_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define SCANNER_AVX2
+#include <immintrin.h>
+#define SCANNER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+/// @internal
+INTERNAL_DEF inline bool scanner_is_space(char t_c) {
+  return t_c == ' ' || t_c == '\r';
+}
+
+/// @internal
+INTERNAL_DEF inline bool scanner_is_digit(char t_c) {
+  return (unsigned char)(t_c - '0') < 10;
+}
+
+/// @internal
+INTERNAL_DEF inline bool scanner_is_ident(char t_c) {
+  return (unsigned char)((t_c | 0x20) - 'a') < 26 || scanner_is_digit(t_c);
+}
+
+/// @internal
+INTERNAL_DEF size_t scanner_skip_space_scalar(const char *t_buf, size_t t_idx,
+                                              size_t t_size) {
+  while (t_idx < t_size && scanner_is_space(t_buf[t_idx])) t_idx++;
+  return t_idx;
+}
+
+/// @internal
+INTERNAL_DEF size_t scanner_skip_ident_scalar(const char *t_buf, size_t t_idx,
+                                              size_t t_size) {
+  while (t_idx < t_size && scanner_is_ident(t_buf[t_idx])) t_idx++;
+  return t_idx;
+}
+
+/// @internal
+INTERNAL_DEF size_t scanner_skip_digits_scalar(const char *t_buf, size_t t_idx,
+                                               size_t t_size) {
+  while (t_idx < t_size && scanner_is_digit(t_buf[t_idx])) t_idx++;
+  return t_idx;
+}
+
+#ifdef SCANNER_SSE2
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif  // _MSC_VER
+
+/// @internal
+INTERNAL_DEF inline unsigned scanner_ctz(uint32_t t_mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long idx;
+  _BitScanForward(&idx, t_mask);
+  return (unsigned)idx;
+#else
+  return (unsigned)__builtin_ctz(t_mask);
+#endif
+}
+
+// SSE2 only has signed byte compares. Adding `0x80 - lo` moves the range
+// [lo, lo + len) down to [-128, -128 + len), which is then a single `<`.
+#define SCANNER_RANGE_SSE2(t_x, t_lo, t_len)                       \
+  _mm_cmplt_epi8(_mm_add_epi8(t_x, _mm_set1_epi8((char)(0x80 - t_lo))), \
+                 _mm_set1_epi8((char)(-128 + t_len)))
+
+/// @internal
+INTERNAL_DEF size_t scanner_skip_space_sse2(const char *t_buf, size_t t_idx,
+                                            size_t t_size) {
+  while (t_idx + 16 <= t_size) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(t_buf + t_idx));
+    __m128i space = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+                                 _mm_cmpeq_epi8(x, _mm_set1_epi8('\r')));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(space) ^ 0xFFFF;
+    if (mask) return t_idx + scanner_ctz(mask);
+    t_idx += 16;
+  }
+  return scanner_skip_space_scalar(t_buf, t_idx, t_size);
+}
+
+/// @internal
+INTERNAL_DEF size_t scanner_skip_ident_sse2(const char *t_buf, size_t t_idx,
+                                            size_t t_size) {
+  while (t_idx + 16 <= t_size) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(t_buf + t_idx));
+    __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    __m128i ident = _mm_or_si128(SCANNER_RANGE_SSE2(lower, 'a', 26),
+                                 SCANNER_RANGE_SSE2(x, '0', 10));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(ident) ^ 0xFFFF;
+    if (mask) return t_idx + scanner_ctz(mask);
+    t_idx += 16;
+  }
+  return scanner_skip_ident_scalar(t_buf, t_idx, t_size);
+}
+
+/// @internal
+INTERNAL_DEF size_t scanner_skip_digits_sse2(const char *t_buf, size_t t_idx,
+                                             size_t t_size) {
+  while (t_idx + 16 <= t_size) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(t_buf + t_idx));
+    uint32_t mask =
+        (uint32_t)_mm_movemask_epi8(SCANNER_RANGE_SSE2(x, '0', 10)) ^ 0xFFFF;
+    if (mask) return t_idx + scanner_ctz(mask);
+    t_idx += 16;
+  }
+  return scanner_skip_digits_scalar(t_buf, t_idx, t_size);
+}
+#endif  // SCANNER_SSE2
+
+#ifdef SCANNER_AVX2
+#define SCANNER_RANGE_AVX2(t_x, t_lo, t_len)                      \
+  _mm256_cmpgt_epi8(                                             \
+      _mm256_set1_epi8((char)(-128 + t_len)),                    \
+      _mm256_add_epi8(t_x, _mm256_set1_epi8((char)(0x80 - t_lo))))
+
+/// @internal
+SCANNER_TARGET_AVX2 INTERNAL_DEF size_t
+scanner_skip_space_avx2(const char *t_buf, size_t t_idx, size_t t_size) {
+  while (t_idx + 32 <= t_size) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(t_buf + t_idx));
+    __m256i space =
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+                        _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\r')));
+    uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(space);
+    if (mask) return t_idx + scanner_ctz(mask);
+    t_idx += 32;
+  }
+  return scanner_skip_space_sse2(t_buf, t_idx, t_size);
+}
+
+/// @internal
+SCANNER_TARGET_AVX2 INTERNAL_DEF size_t
+scanner_skip_ident_avx2(const char *t_buf, size_t t_idx, size_t t_size) {
+  while (t_idx + 32 <= t_size) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(t_buf + t_idx));
+    __m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    __m256i ident = _mm256_or_si256(SCANNER_RANGE_AVX2(lower, 'a', 26),
+                                    SCANNER_RANGE_AVX2(x, '0', 10));
+    uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(ident);
+    if (mask) return t_idx + scanner_ctz(mask);
+    t_idx += 32;
+  }
+  return scanner_skip_ident_sse2(t_buf, t_idx, t_size);
+}
+
+/// @internal
+SCANNER_TARGET_AVX2 INTERNAL_DEF size_t
+scanner_skip_digits_avx2(const char *t_buf, size_t t_idx, size_t t_size) {
+  while (t_idx + 32 <= t_size) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(t_buf + t_idx));
+    __m256i digit = SCANNER_RANGE_AVX2(x, '0', 10);
+    uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(digit);
+    if (mask) return t_idx + scanner_ctz(mask);
+    t_idx += 32;
+  }
+  return scanner_skip_digits_sse2(t_buf, t_idx, t_size);
+}
+#endif  // SCANNER_AVX2
+
+scanner_t scanner_scalar(void) {
+  return (scanner_t){.skip_space = scanner_skip_space_scalar,
+                     .skip_ident = scanner_skip_ident_scalar,
+                     .skip_digits = scanner_skip_digits_scalar,
+                     .name = "scalar"};
+}
+
+scanner_t scanner_select(void) {
+#ifdef SCANNER_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    return (scanner_t){.skip_space = scanner_skip_space_avx2,
+                       .skip_ident = scanner_skip_ident_avx2,
+                       .skip_digits = scanner_skip_digits_avx2,
+                       .name = "avx2"};
+  }
+#endif  // SCANNER_AVX2
+#ifdef SCANNER_SSE2
+  return (scanner_t){.skip_space = scanner_skip_space_sse2,
+                     .skip_ident = scanner_skip_ident_sse2,
+                     .skip_digits = scanner_skip_digits_sse2,
+                     .name = "sse2"};
+#else
+  return scanner_scalar();
+#endif  // SCANNER_SSE2
+}
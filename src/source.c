@@ -0,0 +1,130 @@
+#include "source.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "defines.h"
+#include "utils.h"
+
+#if defined(BUILD_LINUX)
+#include <sys/mman.h>
+#endif  // BUILD_LINUX
+
+/// @internal
+INTERNAL_DEF bool source_open_stream(source_t *t_source, const char *t_file,
+                                     rstr_allocator *t_allocator) {
+  struct rstr buffer = {};
+  bool success;
+  if (!strcmp(t_file, SOURCE_STDIN)) {
+    success = utils_read_stream(stdin, &buffer, t_allocator);
+  } else {
+    success = utils_read_file(t_file, &buffer, t_allocator);
+  }
+  if (!success) return false;
+  t_source->view = rsv_rstr(buffer);
+  return true;
+}
+
+#if defined(BUILD_WINDOWS)
+bool source_open(source_t *t_source, const char *t_file,
+                 rstr_allocator *t_allocator) {
+  *t_source = (source_t){.view = RSV_NULL,
+                         .map = nullptr,
+                         .map_size = 0,
+                         .file = INVALID_HANDLE_VALUE,
+                         .mapping = nullptr};
+  if (!strcmp(t_file, SOURCE_STDIN)) {
+    return source_open_stream(t_source, t_file, t_allocator);
+  }
+
+  HANDLE file = CreateFileA(t_file, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    fprintf(stderr, "Error: could not open file `%s`: %lu\n", t_file,
+            GetLastError());
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    return source_open_stream(t_source, t_file, t_allocator);
+  }
+  if (size.QuadPart == 0) {
+    // Empty files cannot be mapped
+    CloseHandle(file);
+    t_source->view = (rsv){.m_str = "", .m_size = 0};
+    return true;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  void *map = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+  if (!map) {
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+    return source_open_stream(t_source, t_file, t_allocator);
+  }
+  t_source->file = file;
+  t_source->mapping = mapping;
+  t_source->map = map;
+  t_source->map_size = (size_t)size.QuadPart;
+  t_source->view = (rsv){.m_str = map, .m_size = t_source->map_size};
+  return true;
+}
+
+void source_close(source_t *t_source) {
+  if (t_source->map) {
+    UnmapViewOfFile(t_source->map);
+    CloseHandle(t_source->mapping);
+    CloseHandle(t_source->file);
+  }
+  *t_source = (source_t){.view = RSV_NULL,
+                         .map = nullptr,
+                         .map_size = 0,
+                         .file = INVALID_HANDLE_VALUE,
+                         .mapping = nullptr};
+}
+#else
+bool source_open(source_t *t_source, const char *t_file,
+                 rstr_allocator *t_allocator) {
+  *t_source = (source_t){.view = RSV_NULL, .map = nullptr, .map_size = 0};
+  if (!strcmp(t_file, SOURCE_STDIN)) {
+    return source_open_stream(t_source, t_file, t_allocator);
+  }
+
+  int fd = open(t_file, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Error: could not open file `%s`: %s\n", t_file,
+            strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return source_open_stream(t_source, t_file, t_allocator);
+  }
+  if (st.st_size == 0) {
+    // Empty files cannot be mapped
+    close(fd);
+    t_source->view = (rsv){.m_str = "", .m_size = 0};
+    return true;
+  }
+
+  void *map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file
+  close(fd);
+  if (map == MAP_FAILED) {
+    return source_open_stream(t_source, t_file, t_allocator);
+  }
+  // The tokenizer walks the buffer front to back exactly once
+  madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+  t_source->map = map;
+  t_source->map_size = (size_t)st.st_size;
+  t_source->view = (rsv){.m_str = map, .m_size = t_source->map_size};
+  return true;
+}
+
+void source_close(source_t *t_source) {
+  if (t_source->map) munmap(t_source->map, t_source->map_size);
+  *t_source = (source_t){.view = RSV_NULL, .map = nullptr, .map_size = 0};
+}
+#endif  // BUILD_WINDOWS
@@ -0,0 +1,137 @@
+#include "stream.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "defines.h"
+#include "emitter.h"
+#include "generator.h"
+#include "libraries/rit_dyn_arr.h"
+#include "libraries/rit_str.h"
+#include "parser.h"
+#include "source.h"
+#include "symbols.h"
+#include "tokenizer.h"
+
+/// Bytes read from the source at a time. The window only grows past this
+/// for a line that does not fit in it.
+#define STREAM_WINDOW_SIZE (1 << 20)
+
+/// @internal
+/// Lexes, parses and generates the whole lines in `t_lines`. Returns whether
+/// they parsed, the tokenizer's line count is moved past them either way.
+INTERNAL_DEF bool stream_lines(tokenizer_t *t_tokenizer, parser_t *t_parser,
+                               generator_t *t_gen, rsv t_lines) {
+  t_tokenizer->buffer = t_lines;
+  t_tokenizer->idx = 0;
+  tokenize_batch(t_tokenizer, rsv_size(t_lines));
+  node_prg_reset(&t_parser->prg);
+  t_parser->idx = 0;
+  bool success = parse(t_parser);
+  if (success) generate_stmts(t_gen, &t_parser->prg);
+  // Every window starts at the beginning of a line
+  t_tokenizer->line_base += rda_size(t_tokenizer->newlines);
+  return success;
+}
+
+bool compile_file_streamed(const char *t_file, const char *t_out_file) {
+  const char *out_file = t_out_file ? t_out_file : "out.c";
+  bool from_stdin = !strcmp(t_file, SOURCE_STDIN);
+  FILE *in = from_stdin ? stdin : fopen(t_file, "rb");
+  if (!in) {
+    fprintf(stderr, "Error: could not open file `%s`: %s\n", t_file,
+            strerror(errno));
+    return false;
+  }
+  emitter_file_t out;
+  if (!emitter_open(out_file, &out)) {
+    if (!from_stdin) fclose(in);
+    return false;
+  }
+
+  arena_allocator_t arena = {};
+  rda_allocator allocator = {arena_allocator_alloc, arena_allocator_free,
+                             arena_allocator_realloc, &arena};
+  tokenizer_t tokenizer = {.tokens = {},
+                           .newlines = {},
+                           .errors = {},
+                           .line_base = 0,
+                           .line_base_offset = 0,
+                           .idx = 0,
+                           .buffer = RSV_NULL,
+                           .source = {},
+                           .allocator = &allocator};
+  rda_init(tokenizer.tokens.kinds, 0, sizeof(uint8_t), &allocator);
+  rda_init(tokenizer.tokens.offsets, 0, sizeof(uint32_t), &allocator);
+  rda_init(tokenizer.tokens.lens, 0, sizeof(uint32_t), &allocator);
+  rda_init(tokenizer.tokens.syms, 0, sizeof(uint32_t), &allocator);
+  rda_init(tokenizer.newlines, 0, sizeof(uint32_t), &allocator);
+  rda_init(tokenizer.errors, 0, sizeof(uint32_t), &allocator);
+  symbols_init(&tokenizer.symbols, &allocator);
+  parser_t parser = {.idx = 0,
+                     .prg = {},
+                     .expr_frames = {},
+                     .allocator = &allocator,
+                     .owns_allocator = false,
+                     .tokenizer = &tokenizer};
+  node_prg_init(&parser.prg, &allocator);
+  rda_init(parser.expr_frames, 0, sizeof(parser_expr_frame), &allocator);
+  generator_t gen;
+  generator_init(&gen, STREAM_WINDOW_SIZE, &tokenizer.symbols, &allocator);
+
+  // The window is reallocated in place as it grows, so it lives outside the
+  // arena
+  size_t window_size = STREAM_WINDOW_SIZE;
+  char *window = malloc(window_size);
+  size_t len = 0;
+  bool eof = false;
+  bool parsed = true;
+  bool written = true;
+  while (!eof) {
+    size_t read = fread(window + len, 1, window_size - len, in);
+    len += read;
+    if (len < window_size) {
+      if (ferror(in)) {
+        fprintf(stderr, "Error: could not read file `%s`: %s\n", t_file,
+                strerror(errno));
+        parsed = false;
+        break;
+      }
+      eof = true;
+    }
+
+    // Only hand over whole lines, no statement spans one
+    size_t end = len;
+    if (!eof) {
+      while (end > 0 && window[end - 1] != '\n') --end;
+      if (end == 0) {
+        window_size *= 2;
+        window = realloc(window, window_size);
+        continue;
+      }
+    }
+    rsv lines = {.m_str = window, .m_size = end};
+    parsed = stream_lines(&tokenizer, &parser, &gen, lines) && parsed;
+    // Nothing more is written once a statement failed to parse, but the rest
+    // of the file is still read to report its errors
+    if (parsed && written) written = emitter_flush(&gen.emitter, out);
+    memmove(window, window + end, len - end);
+    len -= end;
+  }
+  if (parsed && written) {
+    generator_close(&gen);
+    written = emitter_flush(&gen.emitter, out);
+  }
+  written = emitter_close(out_file, out) && written;
+  bool success = parsed && written;
+  if (!success && strcmp(out_file, "-")) remove(out_file);
+
+  free(window);
+  if (!from_stdin) fclose(in);
+  arena_allocator_free(&arena, nullptr);
+  return success;
+}
@@ -0,0 +1,78 @@
+#include "symbols.h"
+
+#include <string.h>
+
+#include "defines.h"
+
+#define SYMBOLS_INITIAL_SLOTS 256
+
+static const char *keyword_strs[] = {"exit"};
+
+/// @internal
+INTERNAL_DEF uint32_t *symbols_alloc_slots(symbols_t *t_symbols,
+                                           size_t t_slots_len) {
+  uint32_t *slots = t_symbols->allocator->alloc(
+      t_symbols->allocator->m_ctx, t_slots_len * sizeof(uint32_t));
+  memset(slots, 0, t_slots_len * sizeof(uint32_t));
+  return slots;
+}
+
+/// @internal
+/// Doubles the slot array and reinserts every symbol using its stored hash.
+/// The old slots are left to the arena.
+INTERNAL_DEF void symbols_grow(symbols_t *t_symbols) {
+  size_t slots_len = t_symbols->slots_len * 2;
+  uint32_t *slots = symbols_alloc_slots(t_symbols, slots_len);
+  size_t mask = slots_len - 1;
+  for (size_t id = 0; id < symbols_size(t_symbols); ++id) {
+    size_t slot = rda_at(t_symbols->hashes, id) & mask;
+    while (slots[slot]) slot = (slot + 1) & mask;
+    slots[slot] = (uint32_t)id + 1;
+  }
+  t_symbols->slots = slots;
+  t_symbols->slots_len = slots_len;
+}
+
+void symbols_init(symbols_t *t_symbols, rstr_allocator *t_allocator) {
+  *t_symbols = (symbols_t){.names = {},
+                           .hashes = {},
+                           .slots = nullptr,
+                           .slots_len = SYMBOLS_INITIAL_SLOTS,
+                           .allocator = t_allocator};
+  rda_init(t_symbols->names, 0, sizeof(rsv), t_allocator);
+  rda_init(t_symbols->hashes, 0, sizeof(uint32_t), t_allocator);
+  t_symbols->slots = symbols_alloc_slots(t_symbols, t_symbols->slots_len);
+  for (size_t i = 0; i < symbol_keywords_len; ++i) {
+    symbols_intern(t_symbols, keyword_strs[i], strlen(keyword_strs[i]));
+  }
+}
+
+symbol_id symbols_intern_hashed(symbols_t *t_symbols, const char *t_str,
+                                size_t t_len, uint32_t t_hash) {
+  const uint32_t *hashes = rda_data(t_symbols->hashes);
+  const rsv *names = rda_data(t_symbols->names);
+  size_t mask = t_symbols->slots_len - 1;
+  size_t slot = t_hash & mask;
+  while (t_symbols->slots[slot]) {
+    symbol_id id = t_symbols->slots[slot] - 1;
+    if (hashes[id] == t_hash && rsv_size(names[id]) == t_len &&
+        !memcmp(rsv_get(names[id]), t_str, t_len)) {
+      return id;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  // Not found, `slot` is the empty slot the symbol goes into
+  symbol_id id = (symbol_id)symbols_size(t_symbols);
+  char *str = t_symbols->allocator->alloc(t_symbols->allocator->m_ctx, t_len);
+  memcpy(str, t_str, t_len);
+  rda_push_back(t_symbols->names, ((rsv){.m_str = str, .m_size = t_len}),
+                t_symbols->allocator);
+  rda_push_back(t_symbols->hashes, t_hash, t_symbols->allocator);
+  t_symbols->slots[slot] = id + 1;
+  // Keep the load factor under 1/2
+  if (symbols_size(t_symbols) * 2 > t_symbols->slots_len) {
+    symbols_grow(t_symbols);
+  }
+  return id;
+}
@@ -0,0 +1,126 @@
+#include "timer.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "defines.h"
+#include "thread.h"
+
+/// @internal
+INTERNAL_DEF const char *timer_pass_names[timer_passes_len] = {
+    [timer_read] = "read",       [timer_lex] = "lex",
+    [timer_parse] = "parse",     [timer_fold] = "fold",
+    [timer_dead_decls] = "dead-decls", [timer_generate] = "generate",
+    [timer_execute] = "execute",
+};
+
+/// @internal
+INTERNAL_DEF const timer_unit timer_pass_units[timer_passes_len] = {
+    [timer_read] = timer_unit_bytes,  [timer_lex] = timer_unit_bytes,
+    [timer_parse] = timer_unit_tokens, [timer_fold] = timer_unit_nodes,
+    [timer_dead_decls] = timer_unit_nodes, [timer_generate] = timer_unit_nodes,
+    [timer_execute] = timer_unit_none,
+};
+
+/// @internal
+INTERNAL_DEF const char *timer_unit_names[] = {
+    [timer_unit_none] = "",
+    [timer_unit_bytes] = "bytes",
+    [timer_unit_tokens] = "tokens",
+    [timer_unit_nodes] = "nodes",
+};
+
+void timer_merge(timer_passes_t *t_dst, const timer_passes_t *t_src) {
+  for (size_t i = 0; i < timer_passes_len; ++i) {
+    thread_atomic_add_u64(&t_dst->ns[i], t_src->ns[i]);
+    thread_atomic_add_u64(&t_dst->items[i], t_src->items[i]);
+    const timer_memory *src = &t_src->memory[i];
+    timer_memory *dst = &t_dst->memory[i];
+    thread_atomic_add_u64(&dst->allocs, src->allocs);
+    thread_atomic_add_u64(&dst->requested, src->requested);
+    thread_atomic_add_u64(&dst->moved, src->moved);
+    thread_atomic_add_u64(&dst->blocks, src->blocks);
+    // The workers' arenas are separate, so their peaks do not add up
+    thread_atomic_max_u64(&dst->peak, src->peak);
+  }
+}
+
+void timer_print(const timer_passes_t *t_timers, bool t_json) {
+  uint64_t total_ns = 0;
+  for (size_t i = 0; i < timer_passes_len; ++i) total_ns += t_timers->ns[i];
+  if (t_json) {
+    fprintf(stderr, "{\"total_ns\": %llu, \"passes\": [",
+            (unsigned long long)total_ns);
+  } else {
+    fprintf(stderr, "%-12s %12s %7s %16s\n", "pass", "time (ms)", "share",
+            "throughput");
+  }
+
+  bool first = true;
+  for (size_t i = 0; i < timer_passes_len; ++i) {
+    uint64_t ns = t_timers->ns[i];
+    uint64_t items = t_timers->items[i];
+    // Phases that never ran, like `execute` when compiling, are left out
+    if (!ns && !items) continue;
+    double share = total_ns ? (double)ns / (double)total_ns : 0.0;
+    double per_sec = ns ? (double)items * 1e9 / (double)ns : 0.0;
+    timer_unit unit = timer_pass_units[i];
+    if (t_json) {
+      fprintf(stderr,
+              "%s\n  {\"name\": \"%s\", \"ns\": %llu, \"share\": %.4f, "
+              "\"items\": %llu, \"unit\": \"%s\", \"items_per_sec\": %.0f}",
+              first ? "" : ",", timer_pass_names[i], (unsigned long long)ns,
+              share, (unsigned long long)items, timer_unit_names[unit],
+              per_sec);
+    } else if (unit == timer_unit_none) {
+      fprintf(stderr, "%-12s %12.3f %6.1f%%\n", timer_pass_names[i], ns / 1e6,
+              share * 100);
+    } else {
+      fprintf(stderr, "%-12s %12.3f %6.1f%% %9.2f M%s/s\n",
+              timer_pass_names[i], ns / 1e6, share * 100, per_sec / 1e6,
+              timer_unit_names[unit]);
+    }
+    first = false;
+  }
+
+  if (t_json) {
+    fprintf(stderr, "\n]}\n");
+  } else {
+    fprintf(stderr, "%-12s %12.3f %6.1f%%\n", "total", total_ns / 1e6, 100.0);
+  }
+}
+
+void timer_print_memory(const timer_passes_t *t_timers, bool t_json) {
+  if (t_json) {
+    fprintf(stderr, "{\"passes\": [");
+  } else {
+    fprintf(stderr, "%-12s %10s %14s %14s %8s %14s\n", "pass", "allocs",
+            "requested", "realloc waste", "blocks", "peak");
+  }
+
+  bool first = true;
+  for (size_t i = 0; i < timer_passes_len; ++i) {
+    const timer_memory *memory = &t_timers->memory[i];
+    if (!t_timers->ns[i] && !t_timers->items[i]) continue;
+    if (t_json) {
+      fprintf(stderr,
+              "%s\n  {\"name\": \"%s\", \"allocs\": %llu, \"requested\": %llu, "
+              "\"realloc_waste\": %llu, \"blocks\": %llu, \"peak\": %llu}",
+              first ? "" : ",", timer_pass_names[i],
+              (unsigned long long)memory->allocs,
+              (unsigned long long)memory->requested,
+              (unsigned long long)memory->moved,
+              (unsigned long long)memory->blocks,
+              (unsigned long long)memory->peak);
+    } else {
+      fprintf(stderr, "%-12s %10llu %14llu %14llu %8llu %14llu\n",
+              timer_pass_names[i], (unsigned long long)memory->allocs,
+              (unsigned long long)memory->requested,
+              (unsigned long long)memory->moved,
+              (unsigned long long)memory->blocks,
+              (unsigned long long)memory->peak);
+    }
+    first = false;
+  }
+  if (t_json) fprintf(stderr, "\n]}\n");
+}
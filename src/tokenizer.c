@@ -1,191 +1,411 @@
 #include "tokenizer.h"
 
-#include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "allocator.h"
 #include "defines.h"
-#include "libraries/arena_allocator.h"
+#include "scanner.h"
+#include "thread.h"
 #include "utils.h"
 
-INTERNAL_DEF char tokenizer_peek(tokenizer_t *t_tokenizer) {
-  return rstr_at(t_tokenizer->buffer, t_tokenizer->idx);
+/// @internal
+/// Every byte maps to exactly one class, so the main loop of `tokenize()`
+/// dispatches once per token instead of walking an `if`/`else` chain of
+/// `isalpha()`/`isdigit()` calls. Bytes left out are `char_invalid`.
+typedef enum {
+  char_invalid,
+  char_space,
+  char_newline,
+  char_alpha,
+  char_digit,
+  char_symbol,
+} char_class;
+
+INTERNAL_DEF const uint8_t char_classes[256] = {
+    [' '] = char_space,    ['\r'] = char_space,   ['\n'] = char_newline,
+    ['+'] = char_symbol,   ['-'] = char_symbol,   ['*'] = char_symbol,
+    ['/'] = char_symbol,   ['='] = char_symbol,   ['('] = char_symbol,
+    [')'] = char_symbol,   ['{'] = char_symbol,   ['}'] = char_symbol,
+    [':'] = char_symbol,   [';'] = char_symbol,
+    ['A'] = char_alpha,    ['B'] = char_alpha,    ['C'] = char_alpha,
+    ['D'] = char_alpha,    ['E'] = char_alpha,    ['F'] = char_alpha,
+    ['G'] = char_alpha,    ['H'] = char_alpha,    ['I'] = char_alpha,
+    ['J'] = char_alpha,    ['K'] = char_alpha,    ['L'] = char_alpha,
+    ['M'] = char_alpha,    ['N'] = char_alpha,    ['O'] = char_alpha,
+    ['P'] = char_alpha,    ['Q'] = char_alpha,    ['R'] = char_alpha,
+    ['S'] = char_alpha,    ['T'] = char_alpha,    ['U'] = char_alpha,
+    ['V'] = char_alpha,    ['W'] = char_alpha,    ['X'] = char_alpha,
+    ['Y'] = char_alpha,    ['Z'] = char_alpha,
+    ['a'] = char_alpha,    ['b'] = char_alpha,    ['c'] = char_alpha,
+    ['d'] = char_alpha,    ['e'] = char_alpha,    ['f'] = char_alpha,
+    ['g'] = char_alpha,    ['h'] = char_alpha,    ['i'] = char_alpha,
+    ['j'] = char_alpha,    ['k'] = char_alpha,    ['l'] = char_alpha,
+    ['m'] = char_alpha,    ['n'] = char_alpha,    ['o'] = char_alpha,
+    ['p'] = char_alpha,    ['q'] = char_alpha,    ['r'] = char_alpha,
+    ['s'] = char_alpha,    ['t'] = char_alpha,    ['u'] = char_alpha,
+    ['v'] = char_alpha,    ['w'] = char_alpha,    ['x'] = char_alpha,
+    ['y'] = char_alpha,    ['z'] = char_alpha,
+    ['0'] = char_digit,    ['1'] = char_digit,    ['2'] = char_digit,
+    ['3'] = char_digit,    ['4'] = char_digit,    ['5'] = char_digit,
+    ['6'] = char_digit,    ['7'] = char_digit,    ['8'] = char_digit,
+    ['9'] = char_digit,
+};
+
+/// @internal
+/// Token type of each `char_symbol` byte.
+INTERNAL_DEF const uint8_t symbol_tokens[256] = {
+    ['+'] = token_plus,        ['-'] = token_minus,
+    ['*'] = token_star,        ['/'] = token_fslash,
+    ['='] = token_assignment,  ['('] = token_open_paren,
+    [')'] = token_close_paren, ['{'] = token_open_curly,
+    ['}'] = token_close_curly, [':'] = token_colon,
+    [';'] = token_semicolon,
+};
+
+/// @internal
+/// Token type of each keyword, indexed by its symbol id.
+INTERNAL_DEF const uint8_t keyword_tokens[symbol_keywords_len] = {
+    [symbol_exit] = token_exit,
+};
+
+/// @internal
+INTERNAL_DEF void tokenizer_push(tokenizer_t *t_tokenizer, token_type t_type,
+                                 size_t t_start, symbol_id t_sym) {
+  rda_push_back(t_tokenizer->tokens.kinds, (uint8_t)t_type,
+                t_tokenizer->allocator);
+  rda_push_back(t_tokenizer->tokens.offsets, (uint32_t)t_start,
+                t_tokenizer->allocator);
+  rda_push_back(t_tokenizer->tokens.lens,
+                (uint32_t)(t_tokenizer->idx - t_start), t_tokenizer->allocator);
+  rda_push_back(t_tokenizer->tokens.syms, t_sym, t_tokenizer->allocator);
 }
 
-INTERNAL_DEF void tokenizer_consume(tokenizer_t *t_tokenizer) {
-  t_tokenizer->idx++;
-  t_tokenizer->col++;
+/// Typical source has a token every few bytes, the token arrays are sized for
+/// this many bytes per token before lexing, so they rarely grow
+#define TOKENIZE_BYTES_PER_TOKEN 4
+
+/// @internal
+/// Makes room for `t_len` tokens in the empty token arrays, so they are
+/// allocated once at the right size instead of doubling their way up to it.
+INTERNAL_DEF void tokenizer_reserve(tokenizer_t *t_tokenizer, size_t t_len) {
+  // `rda_init()` reserves twice the size given
+  size_t half = t_len / 2 + 1;
+  rda_init(t_tokenizer->tokens.kinds, half, sizeof(uint8_t),
+           t_tokenizer->allocator);
+  rda_init(t_tokenizer->tokens.offsets, half, sizeof(uint32_t),
+           t_tokenizer->allocator);
+  rda_init(t_tokenizer->tokens.lens, half, sizeof(uint32_t),
+           t_tokenizer->allocator);
+  rda_init(t_tokenizer->tokens.syms, half, sizeof(uint32_t),
+           t_tokenizer->allocator);
+  t_tokenizer->tokens.kinds.m_size = 0;
+  t_tokenizer->tokens.offsets.m_size = 0;
+  t_tokenizer->tokens.lens.m_size = 0;
+  t_tokenizer->tokens.syms.m_size = 0;
 }
 
-tokenizer_t tokenizer_init(const char *t_file, rstr_allocator *t_allocator) {
+bool tokenizer_init(tokenizer_t *t_tokenizer, const char *t_file,
+                    rstr_allocator *t_allocator) {
   tokenizer_t ret = {.tokens = {},
+                     .newlines = {},
+                     .errors = {},
+                     .line_base = 0,
+                     .line_base_offset = 0,
                      .idx = 0,
-                     .line = 1,
-                     .col = 1,
-                     .buffer = {},
+                     .buffer = RSV_NULL,
+                     .source = {},
                      .allocator = t_allocator};
-  rda_init(ret.tokens, 0, sizeof(token_t), t_allocator);
-  ret.buffer = utils_read_file(t_file, t_allocator);
+  rda_init(ret.tokens.kinds, 0, sizeof(uint8_t), t_allocator);
+  rda_init(ret.tokens.offsets, 0, sizeof(uint32_t), t_allocator);
+  rda_init(ret.tokens.lens, 0, sizeof(uint32_t), t_allocator);
+  rda_init(ret.tokens.syms, 0, sizeof(uint32_t), t_allocator);
+  rda_init(ret.newlines, 0, sizeof(uint32_t), t_allocator);
+  rda_init(ret.errors, 0, sizeof(uint32_t), t_allocator);
+  if (!source_open(&ret.source, t_file, t_allocator)) return false;
+  // Token offsets are stored as 32-bit integers
+  if (rsv_size(ret.source.view) > UINT32_MAX) {
+    fprintf(stderr, "Error: `%s` is too big, files over 4 GiB are not "
+            "supported\n", t_file);
+    source_close(&ret.source);
+    return false;
+  }
+  ret.buffer = ret.source.view;
+  symbols_init(&ret.symbols, t_allocator);
 
-  return ret;
+  *t_tokenizer = ret;
+  return true;
 }
 
-void tokenize(tokenizer_t *t_tokenizer) {
-  while (t_tokenizer->idx < rstr_size(t_tokenizer->buffer)) {
-    // Identifiers and keywords
-    if (isalpha(tokenizer_peek(t_tokenizer))) {
-      token_t tok;
-      tok.line = t_tokenizer->line;
-      tok.col = t_tokenizer->col;
-      struct rstr value = {};
-      rstr_init(value, 0, t_tokenizer->allocator);
-      rstr_push_back(value, tokenizer_peek(t_tokenizer),
-                     t_tokenizer->allocator);
-      tokenizer_consume(t_tokenizer);
-
-      while (isalnum(tokenizer_peek(t_tokenizer))) {
-        rstr_push_back(value, tokenizer_peek(t_tokenizer),
-                       t_tokenizer->allocator);
-        tokenizer_consume(t_tokenizer);
+void tokenizer_deinit(tokenizer_t *t_tokenizer) {
+  source_close(&t_tokenizer->source);
+  t_tokenizer->buffer = RSV_NULL;
+}
+
+token_loc_t tokenizer_loc(tokenizer_t *t_tokenizer, size_t t_offset) {
+  // Find how many newlines come before `t_offset`
+  size_t lo = 0;
+  size_t hi = rda_size(t_tokenizer->newlines);
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (rda_at(t_tokenizer->newlines, mid) < t_offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  size_t line_start = lo == 0 ? t_tokenizer->line_base_offset
+                              : rda_at(t_tokenizer->newlines, lo - 1) + 1;
+  return (token_loc_t){.line = t_tokenizer->line_base + lo + 1,
+                       .col = t_offset - line_start + 1};
+}
+
+/// @internal
+/// Lexes from `t_tokenizer->idx` up to `t_end`, which must be the end of the
+/// buffer or just past a newline, since no token spans one.
+INTERNAL_DEF void tokenize_range(tokenizer_t *t_tokenizer, size_t t_end,
+                                 scanner_t t_scanner) {
+  const char *buf = rsv_get(t_tokenizer->buffer);
+  size_t size = t_end;
+
+  while (t_tokenizer->idx < size) {
+    size_t start = t_tokenizer->idx;
+    unsigned char c = (unsigned char)buf[start];
+    switch (char_classes[c]) {
+      // Things to ignore
+      case char_space: {
+        // Most runs are a single space, only hand longer ones to the kernel
+        size_t end = start + 1;
+        if (end < size && char_classes[(unsigned char)buf[end]] == char_space) {
+          end = t_scanner.skip_space(buf, end, size);
+        }
+        t_tokenizer->idx = end;
+        break;
       }
-      char *str = "exit";
-      if (!strcmp(rstr_cstr(value), str)) {
-        tok.type = token_exit;
-        tok.value = RSV_NULL;
-      } else {
-        tok.type = token_ident;
-        tok.value = rsv_rstr(value);
+      case char_newline: {
+        t_tokenizer->idx++;
+        tokenizer_push(t_tokenizer, token_newline, start, 0);
+        rda_push_back(t_tokenizer->newlines, (uint32_t)start,
+                      t_tokenizer->allocator);
+        break;
       }
-      rda_push_back(t_tokenizer->tokens, tok, t_tokenizer->allocator);
-    }
-    // Numbers
-    else if (isdigit(tokenizer_peek(t_tokenizer))) {
-      token_t tok;
-      tok.line = t_tokenizer->line;
-      tok.col = t_tokenizer->col;
-      struct rstr value = {};
-      rstr_init(value, 0, t_tokenizer->allocator);
-      rstr_push_back(value, tokenizer_peek(t_tokenizer),
-                     t_tokenizer->allocator);
-      tokenizer_consume(t_tokenizer);
-      while (isdigit(tokenizer_peek(t_tokenizer))) {
-        rstr_push_back(value, tokenizer_peek(t_tokenizer),
-                       t_tokenizer->allocator);
-        tokenizer_consume(t_tokenizer);
+      // Identifiers and keywords
+      case char_alpha: {
+        t_tokenizer->idx = t_scanner.skip_ident(buf, start + 1, size);
+        symbol_id sym = symbols_intern(&t_tokenizer->symbols, buf + start,
+                                       t_tokenizer->idx - start);
+        token_type type =
+            sym < symbol_keywords_len ? keyword_tokens[sym] : token_ident;
+        tokenizer_push(t_tokenizer, type, start, sym);
+        break;
+      }
+      // Numbers
+      case char_digit: {
+        t_tokenizer->idx = t_scanner.skip_digits(buf, start + 1, size);
+        tokenizer_push(t_tokenizer, token_num, start, 0);
+        break;
+      }
+      // Operators and symbols
+      case char_symbol: {
+        t_tokenizer->idx++;
+        tokenizer_push(t_tokenizer, symbol_tokens[c], start, 0);
+        break;
+      }
+      default: {
+        rda_push_back(t_tokenizer->errors, (uint32_t)start,
+                      t_tokenizer->allocator);
+        t_tokenizer->idx++;
+        break;
       }
-      tok.type = token_num;
-      tok.value = rsv_rstr(value);
-      rda_push_back(t_tokenizer->tokens, tok, t_tokenizer->allocator);
-    }
-    // Operators
-    else if (tokenizer_peek(t_tokenizer) == '+') {
-      token_t tok = {.type = token_plus,
-                     .value = RSV_NULL,
-                     .line = t_tokenizer->line,
-                     .col = t_tokenizer->col};
-      rda_push_back(t_tokenizer->tokens, tok, t_tokenizer->allocator);
-      tokenizer_consume(t_tokenizer);
-    } else if (tokenizer_peek(t_tokenizer) == '-') {
-      token_t tok = {.type = token_minus,
-                     .value = RSV_NULL,
-                     .line = t_tokenizer->line,
-                     .col = t_tokenizer->col};
-      rda_push_back(t_tokenizer->tokens, tok, t_tokenizer->allocator);
-      tokenizer_consume(t_tokenizer);
-    } else if (tokenizer_peek(t_tokenizer) == '*') {
-      token_t tok = {.type = token_star,
-                     .value = RSV_NULL,
-                     .line = t_tokenizer->line,
-                     .col = t_tokenizer->col};
-      rda_push_back(t_tokenizer->tokens, tok, t_tokenizer->allocator);
-      tokenizer_consume(t_tokenizer);
-    } else if (tokenizer_peek(t_tokenizer) == '/') {
-      token_t tok = {.type = token_fslash,
-                     .value = RSV_NULL,
-                     .line = t_tokenizer->line,
-                     .col = t_tokenizer->col};
-      rda_push_back(t_tokenizer->tokens, tok, t_tokenizer->allocator);
-      tokenizer_consume(t_tokenizer);
-    } else if (tokenizer_peek(t_tokenizer) == '=') {
-      token_t tok = {.type = token_assignment,
-                     .value = RSV_NULL,
-                     .line = t_tokenizer->line,
-                     .col = t_tokenizer->col};
-      rda_push_back(t_tokenizer->tokens, tok, t_tokenizer->allocator);
-      tokenizer_consume(t_tokenizer);
-    }
-    // Symbols
-    else if (tokenizer_peek(t_tokenizer) == '(') {
-      token_t tok = {.type = token_open_paren,
-                     .value = RSV_NULL,
-                     .line = t_tokenizer->line,
-                     .col = t_tokenizer->col};
-      rda_push_back(t_tokenizer->tokens, tok, t_tokenizer->allocator);
-      tokenizer_consume(t_tokenizer);
-    } else if (tokenizer_peek(t_tokenizer) == ')') {
-      token_t tok = {.type = token_close_paren,
-                     .value = RSV_NULL,
-                     .line = t_tokenizer->line,
-                     .col = t_tokenizer->col};
-      rda_push_back(t_tokenizer->tokens, tok, t_tokenizer->allocator);
-      tokenizer_consume(t_tokenizer);
-    } else if (tokenizer_peek(t_tokenizer) == '{') {
-      token_t tok = {.type = token_open_curly,
-                     .value = RSV_NULL,
-                     .line = t_tokenizer->line,
-                     .col = t_tokenizer->col};
-      rda_push_back(t_tokenizer->tokens, tok, t_tokenizer->allocator);
-      tokenizer_consume(t_tokenizer);
-    } else if (tokenizer_peek(t_tokenizer) == '}') {
-      token_t tok = {.type = token_close_curly,
-                     .value = RSV_NULL,
-                     .line = t_tokenizer->line,
-                     .col = t_tokenizer->col};
-      rda_push_back(t_tokenizer->tokens, tok, t_tokenizer->allocator);
-      tokenizer_consume(t_tokenizer);
-    } else if (tokenizer_peek(t_tokenizer) == ':') {
-      token_t tok = {.type = token_colon,
-                     .value = RSV_NULL,
-                     .line = t_tokenizer->line,
-                     .col = t_tokenizer->col};
-      rda_push_back(t_tokenizer->tokens, tok, t_tokenizer->allocator);
-      tokenizer_consume(t_tokenizer);
-    } else if (tokenizer_peek(t_tokenizer) == ';') {
-      token_t tok = {.type = token_semicolon,
-                     .value = RSV_NULL,
-                     .line = t_tokenizer->line,
-                     .col = t_tokenizer->col};
-      rda_push_back(t_tokenizer->tokens, tok, t_tokenizer->allocator);
-      tokenizer_consume(t_tokenizer);
-    } else if (tokenizer_peek(t_tokenizer) == '\n') {
-      token_t tok = {.type = token_newline,
-                     .value = RSV_NULL,
-                     .line = t_tokenizer->line,
-                     .col = t_tokenizer->col};
-      rda_push_back(t_tokenizer->tokens, tok, t_tokenizer->allocator);
-      tokenizer_consume(t_tokenizer);
-      t_tokenizer->line++;
-      t_tokenizer->col = 1;
     }
-    // Things to ignore
-    else if (tokenizer_peek(t_tokenizer) == '\r') {
-      tokenizer_consume(t_tokenizer);
-    } else if (tokenizer_peek(t_tokenizer) == ' ') {
-      tokenizer_consume(t_tokenizer);
-    } else {
+  }
+}
+
+/// @internal
+/// Ends the token stream, then reports the bytes that started no token.
+INTERNAL_DEF void tokenize_finish(tokenizer_t *t_tokenizer) {
+  tokenizer_push(t_tokenizer, token_eof, t_tokenizer->idx, 0);
+  rda_for_each(it, t_tokenizer->errors) {
+    token_loc_t loc = tokenizer_loc(t_tokenizer, *it);
+    fprintf(stderr, "Error:%zu:%zu: cannot recognize token %c\n", loc.line,
+            loc.col, rsv_get(t_tokenizer->buffer)[*it]);
+  }
+
 #ifdef DEBUG
-      fprintf(stderr, "Error: cannot recognize token %c\n",
-              tokenizer_peek(t_tokenizer));
-      tokenizer_consume(t_tokenizer);
+  for (size_t i = 0; i < tokens_size(&t_tokenizer->tokens); ++i) {
+    token_type type = tokenizer_token_type(t_tokenizer, i);
+    rsv value = type == token_ident || type == token_num
+                    ? tokenizer_token_value(t_tokenizer, i)
+                    : RSV_NULL;
+    token_loc_t loc = tokenizer_token_loc(t_tokenizer, i);
+    printf("[DEBUG] token: %s, token_value: %.*s, line: %zu, col: %zu\n",
+           token_type_to_str(type), (int)rsv_size(value), rsv_get(value),
+           loc.line, loc.col);
+  }
 #endif  // DEBUG
+}
+
+void tokenize(tokenizer_t *t_tokenizer) {
+  tokenizer_reserve(t_tokenizer,
+                    (rsv_size(t_tokenizer->buffer) - t_tokenizer->idx) /
+                        TOKENIZE_BYTES_PER_TOKEN);
+  tokenize_range(t_tokenizer, rsv_size(t_tokenizer->buffer), scanner_select());
+  tokenize_finish(t_tokenizer);
+}
+
+bool tokenize_batch(tokenizer_t *t_tokenizer, size_t t_batch_size) {
+  const char *buf = rsv_get(t_tokenizer->buffer);
+  size_t size = rsv_size(t_tokenizer->buffer);
+  t_tokenizer->tokens.kinds.m_size = 0;
+  t_tokenizer->tokens.offsets.m_size = 0;
+  t_tokenizer->tokens.lens.m_size = 0;
+  t_tokenizer->tokens.syms.m_size = 0;
+  t_tokenizer->newlines.m_size = 0;
+  t_tokenizer->errors.m_size = 0;
+
+  size_t end = size;
+  if (size - t_tokenizer->idx > t_batch_size) {
+    size_t cut = t_tokenizer->idx + t_batch_size;
+    const char *newline = memchr(buf + cut, '\n', size - cut);
+    if (newline) end = (size_t)(newline - buf) + 1;
+  }
+  tokenize_range(t_tokenizer, end, scanner_select());
+  tokenize_finish(t_tokenizer);
+  return end < size;
+}
+
+/// Chunks smaller than this are not worth a thread
+#define TOKENIZE_MIN_CHUNK (1 << 20)
+
+/// @internal
+/// A chunk of the buffer, lexed by its own thread into its own arena.
+typedef struct {
+  tokenizer_t tokenizer;
+  size_t end;
+  scanner_t scanner;
+  arena_allocator_t arena;
+  rstr_allocator allocator;
+} tokenize_chunk;
+
+/// @internal
+INTERNAL_DEF void tokenize_chunk_worker(void *t_chunk) {
+  tokenize_chunk *chunk = t_chunk;
+  tokenize_range(&chunk->tokenizer, chunk->end, chunk->scanner);
+}
+
+/// @internal
+/// Appends the chunk's tokens to `t_tokenizer`. The chunk's symbol ids are
+/// local to it, interning its names in id order maps them to the ids a single
+/// pass would have given them, since ids follow first occurrence.
+INTERNAL_DEF void tokenize_stitch(tokenizer_t *t_tokenizer,
+                                  tokenize_chunk *t_chunk) {
+  tokenizer_t *chunk = &t_chunk->tokenizer;
+  size_t first = tokens_size(&t_tokenizer->tokens);
+  rda_append_rda(t_tokenizer->tokens.kinds, chunk->tokens.kinds,
+                 t_tokenizer->allocator);
+  rda_append_rda(t_tokenizer->tokens.offsets, chunk->tokens.offsets,
+                 t_tokenizer->allocator);
+  rda_append_rda(t_tokenizer->tokens.lens, chunk->tokens.lens,
+                 t_tokenizer->allocator);
+  rda_append_rda(t_tokenizer->tokens.syms, chunk->tokens.syms,
+                 t_tokenizer->allocator);
+  rda_append_rda(t_tokenizer->newlines, chunk->newlines,
+                 t_tokenizer->allocator);
+  rda_append_rda(t_tokenizer->errors, chunk->errors, t_tokenizer->allocator);
+
+  // Keywords are seeded first in every table, so their ids already agree
+  size_t names_len = symbols_size(&chunk->symbols);
+  symbol_id *ids = t_chunk->allocator.alloc(t_chunk->allocator.m_ctx,
+                                            names_len * sizeof(symbol_id));
+  for (size_t id = 0; id < names_len; ++id) {
+    rsv name = symbols_name(&chunk->symbols, (symbol_id)id);
+    ids[id] = id < symbol_keywords_len
+                  ? (symbol_id)id
+                  : symbols_intern(&t_tokenizer->symbols, rsv_get(name),
+                                   rsv_size(name));
+  }
+  const uint8_t *kinds = rda_data(t_tokenizer->tokens.kinds);
+  uint32_t *syms = rda_data(t_tokenizer->tokens.syms);
+  for (size_t i = first; i < tokens_size(&t_tokenizer->tokens); ++i) {
+    if (kinds[i] == token_ident) syms[i] = ids[syms[i]];
+  }
+}
+
+void tokenize_parallel(tokenizer_t *t_tokenizer, size_t t_jobs) {
+  const char *buf = rsv_get(t_tokenizer->buffer);
+  size_t size = rsv_size(t_tokenizer->buffer);
+  size_t jobs = t_jobs ? t_jobs : thread_hardware_concurrency();
+  if (jobs > size / TOKENIZE_MIN_CHUNK) jobs = size / TOKENIZE_MIN_CHUNK;
+  if (jobs <= 1) {
+    tokenize(t_tokenizer);
+    return;
+  }
+
+  scanner_t scanner = scanner_select();
+  tokenize_chunk *chunks = malloc(jobs * sizeof(tokenize_chunk));
+  size_t begin = t_tokenizer->idx;
+  size_t chunks_len = 0;
+  while (begin < size && chunks_len < jobs) {
+    // Cut just past the first newline after an even share of the buffer
+    size_t end = begin + (size - begin) / (jobs - chunks_len);
+    if (chunks_len == jobs - 1 || end >= size) {
+      end = size;
+    } else {
+      const char *newline = memchr(buf + end, '\n', size - end);
+      end = newline ? (size_t)(newline - buf) + 1 : size;
     }
+    tokenize_chunk *chunk = &chunks[chunks_len++];
+    chunk->arena = (arena_allocator_t){};
+    chunk->allocator =
+        (rstr_allocator){arena_allocator_alloc, arena_allocator_free,
+                         arena_allocator_realloc, &chunk->arena};
+    chunk->end = end;
+    chunk->scanner = scanner;
+    chunk->tokenizer = (tokenizer_t){.tokens = {},
+                                     .newlines = {},
+                                     .errors = {},
+                                     .idx = begin,
+                                     .buffer = t_tokenizer->buffer,
+                                     .source = {},
+                                     .allocator = &chunk->allocator};
+    tokenizer_t *tokenizer = &chunk->tokenizer;
+    tokenizer_reserve(tokenizer, (end - begin) / TOKENIZE_BYTES_PER_TOKEN);
+    rda_init(tokenizer->newlines, 0, sizeof(uint32_t), &chunk->allocator);
+    rda_init(tokenizer->errors, 0, sizeof(uint32_t), &chunk->allocator);
+    symbols_init(&tokenizer->symbols, &chunk->allocator);
+    begin = end;
   }
 
-#ifdef DEBUG
-  rda_for_each(it, t_tokenizer->tokens) {
-    printf("[DEBUG] token: %s, token_value: %s, line: %zu, col: %zu\n",
-           token_type_to_str(it->type), rsv_get(it->value), it->line, it->col);
+  // The calling thread lexes the first chunk itself
+  thread_t *threads = malloc(chunks_len * sizeof(thread_t));
+  bool *started = malloc(chunks_len * sizeof(bool));
+  for (size_t i = 1; i < chunks_len; ++i) {
+    started[i] = thread_create(&threads[i], tokenize_chunk_worker, &chunks[i]);
   }
-#endif  // DEBUG
+  tokenize_chunk_worker(&chunks[0]);
+  for (size_t i = 1; i < chunks_len; ++i) {
+    if (started[i]) {
+      thread_join(threads[i]);
+    } else {
+      tokenize_chunk_worker(&chunks[i]);
+    }
+  }
+  free(started);
+  free(threads);
+
+  // The chunks know exactly how many tokens there are, plus the eof
+  size_t tokens_len = 1;
+  for (size_t i = 0; i < chunks_len; ++i) {
+    tokens_len += tokens_size(&chunks[i].tokenizer.tokens);
+  }
+  tokenizer_reserve(t_tokenizer, tokens_len);
+  for (size_t i = 0; i < chunks_len; ++i) {
+    tokenize_stitch(t_tokenizer, &chunks[i]);
+    arena_allocator_free(&chunks[i].arena, nullptr);
+  }
+  free(chunks);
+  t_tokenizer->idx = size;
+  tokenize_finish(t_tokenizer);
 }
@@ -0,0 +1,279 @@
+#include "vm.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "defines.h"
+#include "libraries/rit_dyn_arr.h"
+#include "parser.h"
+#include "symbols.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_COMPUTED_GOTO
+#endif
+
+/// @internal
+typedef struct {
+  expr_idx idx;
+  bool operands_done;
+} vm_compile_frame;
+
+/// @internal
+typedef struct {
+  vm_program *vm_prg;
+  node_prg *prg;
+  symbols_t *symbols;
+  rda_struct(vm_compile_frame) frames;  // Scratch for `vm_compile_expr()`
+  rda_struct(uint32_t) values;  // Registers holding finished subexpressions
+  uint32_t *var_regs;           // Symbol id -> register + 1, 0 if undeclared
+  uint32_t vars_len;            // Variables declared so far
+  uint32_t temps_base;          // Registers below are for variables
+  uint32_t temps_top;           // First free temporary
+  rda_allocator *allocator;
+} vm_compiler;
+
+/// @internal
+INTERNAL_DEF void vm_emit(vm_compiler *t_compiler, vm_opcode t_op,
+                          uint32_t t_dst, uint32_t t_a, uint32_t t_b) {
+  vm_instr instr = {.op = t_op, .dst = t_dst, .a = t_a, .b = t_b};
+  rda_push_back(t_compiler->vm_prg->code, instr, t_compiler->allocator);
+}
+
+/// @internal
+INTERNAL_DEF uint32_t vm_alloc_temp(vm_compiler *t_compiler) {
+  uint32_t reg = t_compiler->temps_top++;
+  if (t_compiler->temps_top > t_compiler->vm_prg->regs_len) {
+    t_compiler->vm_prg->regs_len = t_compiler->temps_top;
+  }
+  return reg;
+}
+
+/// @internal
+INTERNAL_DEF vm_opcode vm_bin_op(token_type t_op) {
+  switch (t_op) {
+    case token_plus:
+      return vm_op_add;
+    case token_minus:
+      return vm_op_sub;
+    case token_star:
+      return vm_op_mul;
+    case token_fslash:
+      return vm_op_div;
+    default: {
+      fprintf(stderr, "Error: unknown operator %s\n", token_type_to_str(t_op));
+      exit(1);
+    }
+  }
+}
+
+/// @internal
+/// Compiles the expression in post-order with an explicit stack and returns
+/// the register that holds its value. Variables are used in place, and a
+/// binary expression reuses the lowest temporary of its operands, so an
+/// expression needs at most one temporary per level of nesting.
+INTERNAL_DEF bool vm_compile_expr(vm_compiler *t_compiler, expr_idx t_idx,
+                                  uint32_t *t_reg) {
+  t_compiler->frames.m_size = 0;
+  t_compiler->values.m_size = 0;
+  vm_compile_frame root = {.idx = t_idx, .operands_done = false};
+  rda_push_back(t_compiler->frames, root, t_compiler->allocator);
+  while (rda_size(t_compiler->frames) > 0) {
+    vm_compile_frame frame =
+        rda_at(t_compiler->frames, rda_size(t_compiler->frames) - 1);
+    t_compiler->frames.m_size--;
+    node_expr *expr = node_prg_expr(t_compiler->prg, frame.idx);
+    uint32_t reg = 0;
+    switch (expr->type) {
+      case expr_num: {
+        reg = vm_alloc_temp(t_compiler);
+        uint32_t konst = (uint32_t)rda_size(t_compiler->vm_prg->consts);
+        rda_push_back(t_compiler->vm_prg->consts, expr->value.num_expr.value,
+                      t_compiler->allocator);
+        vm_emit(t_compiler, vm_op_const, reg, konst, 0);
+        break;
+      }
+      case expr_var: {
+        symbol_id sym = expr->value.var_expr;
+        if (!t_compiler->var_regs[sym]) {
+          rsv name = symbols_name(t_compiler->symbols, sym);
+          fprintf(stderr, "Error: `%.*s` is used before it is declared\n",
+                  (int)rsv_size(name), rsv_get(name));
+          return false;
+        }
+        reg = t_compiler->var_regs[sym] - 1;
+        break;
+      }
+      case expr_bin: {
+        node_bin_expr bin = expr->value.bin_expr;
+        if (!frame.operands_done) {
+          frame.operands_done = true;
+          vm_compile_frame lhs = {.idx = bin.lhs, .operands_done = false};
+          vm_compile_frame rhs = {.idx = bin.rhs, .operands_done = false};
+          rda_push_back(t_compiler->frames, frame, t_compiler->allocator);
+          rda_push_back(t_compiler->frames, rhs, t_compiler->allocator);
+          rda_push_back(t_compiler->frames, lhs, t_compiler->allocator);
+          continue;
+        }
+        size_t values_len = rda_size(t_compiler->values);
+        uint32_t a = rda_at(t_compiler->values, values_len - 2);
+        uint32_t b = rda_at(t_compiler->values, values_len - 1);
+        t_compiler->values.m_size -= 2;
+        // Temporaries are allocated in stack order, so `b` is above `a`
+        if (a >= t_compiler->temps_base) {
+          reg = a;
+        } else if (b >= t_compiler->temps_base) {
+          reg = b;
+        } else {
+          reg = vm_alloc_temp(t_compiler);
+        }
+        t_compiler->temps_top = reg + 1;
+        vm_emit(t_compiler, vm_bin_op(bin.op), reg, a, b);
+        break;
+      }
+    }
+    rda_push_back(t_compiler->values, reg, t_compiler->allocator);
+  }
+  *t_reg = rda_at(t_compiler->values, 0);
+  return true;
+}
+
+bool vm_compile(vm_program *t_vm_prg, node_prg *t_prg, symbols_t *t_symbols,
+                rda_allocator *t_allocator) {
+  rda_init(t_vm_prg->code, 0, sizeof(vm_instr), t_allocator);
+  rda_init(t_vm_prg->consts, 0, sizeof(int64_t), t_allocator);
+  t_vm_prg->code.m_size = 0;
+  t_vm_prg->consts.m_size = 0;
+  vm_compiler compiler = {.vm_prg = t_vm_prg,
+                          .prg = t_prg,
+                          .symbols = t_symbols,
+                          .frames = {},
+                          .values = {},
+                          .var_regs = nullptr,
+                          .vars_len = 0,
+                          .temps_base = 0,
+                          .temps_top = 0,
+                          .allocator = t_allocator};
+  rda_init(compiler.frames, 0, sizeof(vm_compile_frame), t_allocator);
+  rda_init(compiler.values, 0, sizeof(uint32_t), t_allocator);
+  size_t var_regs_size = symbols_size(t_symbols) * sizeof(uint32_t);
+  compiler.var_regs = t_allocator->alloc(t_allocator->m_ctx, var_regs_size);
+  memset(compiler.var_regs, 0, var_regs_size);
+  // Reserve a register for every declaration, temporaries go above them
+  rda_for_each(it, t_prg->stmts) {
+    if (it->type == stmt_var_decl) compiler.temps_base++;
+  }
+  compiler.temps_top = compiler.temps_base;
+  t_vm_prg->regs_len = compiler.temps_base;
+
+  rda_for_each(it, t_prg->stmts) {
+    uint32_t reg = 0;
+    switch (it->type) {
+      case stmt_exit: {
+        if (!vm_compile_expr(&compiler, it->value.exit_stmt.status, &reg)) {
+          return false;
+        }
+        vm_emit(&compiler, vm_op_exit, 0, reg, 0);
+        break;
+      }
+      case stmt_var_decl: {
+        node_stmt_var_decl *decl = &it->value.var_decl_stmt;
+        if (!vm_compile_expr(&compiler, decl->expr, &reg)) return false;
+        // A redeclaration reuses the register of the first one
+        if (!compiler.var_regs[decl->name]) {
+          compiler.var_regs[decl->name] = ++compiler.vars_len;
+        }
+        vm_emit(&compiler, vm_op_store, compiler.var_regs[decl->name] - 1, reg,
+                0);
+        break;
+      }
+      default: {
+        fprintf(stderr, "Error: unknown statment type\n");
+        exit(1);
+      }
+    }
+    compiler.temps_top = compiler.temps_base;
+  }
+  vm_emit(&compiler, vm_op_halt, 0, 0, 0);
+  return true;
+}
+
+#ifdef VM_COMPUTED_GOTO
+#define VM_CASE(t_op) label_##t_op:
+#define VM_NEXT() goto *labels[(++ip)->op]
+#else
+#define VM_CASE(t_op) case t_op:
+#define VM_NEXT() \
+  ++ip;           \
+  continue
+#endif  // VM_COMPUTED_GOTO
+
+bool vm_run(vm_program *t_vm_prg, int *t_status, rda_allocator *t_allocator) {
+  // At least one register, so an empty program does not allocate 0 bytes
+  int64_t *regs = t_allocator->alloc(
+      t_allocator->m_ctx, (t_vm_prg->regs_len + 1) * sizeof(int64_t));
+  const int64_t *consts = rda_data(t_vm_prg->consts);
+  const vm_instr *ip = rda_data(t_vm_prg->code);
+
+#ifdef VM_COMPUTED_GOTO
+  // One indirect jump per instruction, each with its own branch history
+  static void *const labels[] = {
+      [vm_op_const] = &&label_vm_op_const, [vm_op_store] = &&label_vm_op_store,
+      [vm_op_add] = &&label_vm_op_add,     [vm_op_sub] = &&label_vm_op_sub,
+      [vm_op_mul] = &&label_vm_op_mul,     [vm_op_div] = &&label_vm_op_div,
+      [vm_op_exit] = &&label_vm_op_exit,   [vm_op_halt] = &&label_vm_op_halt,
+  };
+  goto *labels[ip->op];
+#else
+  while (true) {
+    switch (ip->op) {
+#endif  // VM_COMPUTED_GOTO
+      VM_CASE(vm_op_const) {
+        regs[ip->dst] = consts[ip->a];
+        VM_NEXT();
+      }
+      VM_CASE(vm_op_store) {
+        regs[ip->dst] = (int32_t)regs[ip->a];
+        VM_NEXT();
+      }
+      // Wrap like the constant folder instead of overflowing
+      VM_CASE(vm_op_add) {
+        regs[ip->dst] = (int64_t)((uint64_t)regs[ip->a] + (uint64_t)regs[ip->b]);
+        VM_NEXT();
+      }
+      VM_CASE(vm_op_sub) {
+        regs[ip->dst] = (int64_t)((uint64_t)regs[ip->a] - (uint64_t)regs[ip->b]);
+        VM_NEXT();
+      }
+      VM_CASE(vm_op_mul) {
+        regs[ip->dst] = (int64_t)((uint64_t)regs[ip->a] * (uint64_t)regs[ip->b]);
+        VM_NEXT();
+      }
+      VM_CASE(vm_op_div) {
+        int64_t a = regs[ip->a];
+        int64_t b = regs[ip->b];
+        if (b == 0 || (a == INT64_MIN && b == -1)) {
+          fprintf(stderr, "Error: division by zero or overflow\n");
+          return false;
+        }
+        regs[ip->dst] = a / b;
+        VM_NEXT();
+      }
+      VM_CASE(vm_op_exit) {
+        *t_status = (int)regs[ip->a];
+        return true;
+      }
+      VM_CASE(vm_op_halt) {
+        *t_status = 0;
+        return true;
+      }
+#ifndef VM_COMPUTED_GOTO
+      default: {
+        fprintf(stderr, "Error: invalid opcode %u\n", ip->op);
+        exit(1);
+      }
+    }
+  }
+#endif  // VM_COMPUTED_GOTO
+}
@@ -0,0 +1,314 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "defines.h"
+#include "generator.h"
+#include "generator_x86_64.h"
+#include "jit.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "utils.h"
+#include "vm.h"
+
+/// Where the programs are written and compiled, `ribs test` creates it
+#define TEST_DIR "build/tests/"
+
+/// Operands of the generated expressions, enough that recursing once per
+/// operator would overflow the call stack
+#define TEST_DEEP_OPERANDS 100000
+
+/// @internal
+/// Writes a program too big to spell out to `t_out`.
+typedef void (*test_write_src)(FILE *t_out);
+
+/// @internal
+/// `1 + 1 + ... + 1`, a single expression nested as deep as it is long.
+INTERNAL_DEF void test_write_deep_sum(FILE *t_out) {
+  fprintf(t_out, "exit(1");
+  for (size_t i = 1; i < TEST_DEEP_OPERANDS; ++i) fprintf(t_out, " + 1");
+  fprintf(t_out, ")\n");
+}
+
+/// @internal
+/// A declaration whose expression reads a variable at every operand.
+INTERNAL_DEF void test_write_deep_vars(FILE *t_out) {
+  fprintf(t_out, "one := 1\nzero := one - one\nx := zero");
+  for (size_t i = 1; i < TEST_DEEP_OPERANDS; ++i) {
+    fprintf(t_out, i % 2 ? " + one" : " * one");
+  }
+  fprintf(t_out, "\nexit(x)\n");
+}
+
+/// @internal
+/// A long chain of every operator, which only adds up to 1 if each of them
+/// binds as in C.
+INTERNAL_DEF void test_write_deep_mixed(FILE *t_out) {
+  fprintf(t_out, "exit(1");
+  for (size_t i = 1; i + 5 <= TEST_DEEP_OPERANDS; i += 5) {
+    fprintf(t_out, " + 2 * 3 - 6 / 2 - 3");
+  }
+  fprintf(t_out, ")\n");
+}
+
+/// A program and the status it must exit with on every backend, at every
+/// optimization level.
+typedef struct {
+  const char *name;
+  const char *src;        // `nullptr` when `write_src` generates it
+  test_write_src write_src;
+  int status;
+} test_case;
+
+/// @internal
+INTERNAL_DEF const test_case test_cases[] = {
+    {"exit", "exit(42)\n", nullptr, 42},
+    {"variables", "x := 7\ny := x * 6\nexit(y)\n", nullptr, 42},
+    // `+` and `-` bind alike and group to the left, so do `*` and `/`
+    {"sum_order", "exit(10 - 2 + 3)\n", nullptr, 11},
+    {"product_order", "exit(3 * 5 / 2)\n", nullptr, 7},
+    {"mixed_order", "exit(2 + 3 * 4 - 10 / 5 * 2)\n", nullptr, 10},
+    {"mixed_order_vars",
+     "a := 20\nb := a - 5 - 3\nc := b / 2 * 3\nexit(c - a / 4 + 1)\n",
+     nullptr, 14},
+    {"deep_sum", nullptr, test_write_deep_sum, TEST_DEEP_OPERANDS & 0xff},
+    // Each `+ one` adds 1, each `* one` keeps the value
+    {"deep_vars", nullptr, test_write_deep_vars,
+     (TEST_DEEP_OPERANDS / 2) & 0xff},
+    {"deep_mixed", nullptr, test_write_deep_mixed, 1},
+};
+#define TEST_CASES_LEN (sizeof(test_cases) / sizeof(test_case))
+
+/// @internal
+/// Runs `t_cmd` through the shell and returns the status it exited with, -1
+/// if it did not exit normally.
+INTERNAL_DEF int test_system(const char *t_cmd) {
+  int result = system(t_cmd);
+#if defined(BUILD_WINDOWS)
+  return result;
+#else
+  if (result < 0 || !WIFEXITED(result)) return -1;
+  return WEXITSTATUS(result);
+#endif  // BUILD_WINDOWS
+}
+
+/// @internal
+/// Tallies of the checks, and the C compiler the generated code is built
+/// with, `nullptr` to skip those backends.
+typedef struct {
+  size_t passed;
+  size_t failed;
+  const char *cc;
+} test_run;
+
+/// @internal
+/// Records whether the `t_backend` run of `t_case` exited with the expected
+/// status, `t_status` is -1 if it failed to run at all.
+INTERNAL_DEF void test_check(test_run *t_run, const test_case *t_case,
+                             opt_level t_level, const char *t_backend,
+                             int t_status) {
+  if (t_status == (t_case->status & 0xff)) {
+    ++t_run->passed;
+    return;
+  }
+  ++t_run->failed;
+  fprintf(stderr, "[FAIL] %s -O%d %s: exited with %d, expected %d\n",
+          t_case->name, (int)t_level, t_backend, t_status,
+          t_case->status & 0xff);
+}
+
+/// @internal
+/// Builds `t_src`, C or with `t_asm` assembly, with the C compiler and runs
+/// it. Returns the status it exited with, -1 if it did not build.
+INTERNAL_DEF int test_build_and_run(const test_run *t_run, const char *t_src,
+                                    const char *t_exe, bool t_asm) {
+  char cmd[1024];
+  bool msvc = !strcmp(t_run->cc, "cl");
+  if (msvc) {
+    snprintf(cmd, sizeof(cmd), "%s -nologo -w -Fe%s.exe %s >NUL", t_run->cc,
+             t_exe, t_src);
+  } else {
+    // The assembly is a freestanding `_start`
+    snprintf(cmd, sizeof(cmd), "%s -w %s -o %s %s", t_run->cc,
+             t_asm ? "-nostdlib -static" : "", t_exe, t_src);
+  }
+  if (test_system(cmd) != 0) return -1;
+#if defined(BUILD_WINDOWS)
+  snprintf(cmd, sizeof(cmd), "%s.exe", t_exe);
+#else
+  snprintf(cmd, sizeof(cmd), "./%s", t_exe);
+#endif  // BUILD_WINDOWS
+  return test_system(cmd);
+}
+
+/// @internal
+/// Compiles `t_file` at `t_level` and runs it on every backend there is.
+INTERNAL_DEF void test_level(test_run *t_run, const test_case *t_case,
+                             const char *t_file, opt_level t_level,
+                             rda_allocator *t_allocator) {
+  parser_t parser;
+  if (!parser_init_with_allocator(&parser, t_file, 0, nullptr, t_allocator)) {
+    test_check(t_run, t_case, t_level, "read", -1);
+    return;
+  }
+  if (!parse(&parser)) {
+    test_check(t_run, t_case, t_level, "parse", -1);
+    parser_deinit(&parser);
+    return;
+  }
+  symbols_t *symbols = &parser.tokenizer->symbols;
+  optimize(&parser.prg, symbols, t_allocator, t_level, nullptr);
+
+  // Like a process, only the low 8 bits of the status count
+  int status = 0;
+  vm_program vm_prg;
+  bool ran = vm_compile(&vm_prg, &parser.prg, symbols, t_allocator) &&
+             vm_run(&vm_prg, &status, t_allocator);
+  test_check(t_run, t_case, t_level, "vm", ran ? status & 0xff : -1);
+#if defined(JIT_SUPPORTED)
+  jit_program jit_prg;
+  ran = jit_compile(&jit_prg, &parser.prg, symbols, t_allocator) &&
+        jit_run(&jit_prg, &status, t_allocator);
+  test_check(t_run, t_case, t_level, "jit", ran ? status & 0xff : -1);
+#endif  // JIT_SUPPORTED
+
+  if (t_run->cc) {
+    char src[256];
+    char exe[256];
+    snprintf(src, sizeof(src), TEST_DIR "%s-O%d.c", t_case->name,
+             (int)t_level);
+    snprintf(exe, sizeof(exe), TEST_DIR "%s-O%d", t_case->name, (int)t_level);
+    status = generate(src, &parser.prg, symbols, t_allocator)
+                 ? test_build_and_run(t_run, src, exe, false)
+                 : -1;
+    test_check(t_run, t_case, t_level, "c", status);
+#if defined(BUILD_LINUX) && defined(__x86_64__)
+    snprintf(src, sizeof(src), TEST_DIR "%s-O%d.s", t_case->name,
+             (int)t_level);
+    snprintf(exe, sizeof(exe), TEST_DIR "%s-O%d-asm", t_case->name,
+             (int)t_level);
+    status = generate_x86_64(src, &parser.prg, symbols, t_allocator)
+                 ? test_build_and_run(t_run, src, exe, true)
+                 : -1;
+    test_check(t_run, t_case, t_level, "asm", status);
+#endif  // BUILD_LINUX && __x86_64__
+  }
+  parser_deinit(&parser);
+}
+
+/// @internal
+/// An empty allocation followed by another must stay apart from it: growing
+/// the empty one may not write over the next, and freeing it may not give
+/// the next one back.
+INTERNAL_DEF void test_arena_empty_alloc(test_run *t_run) {
+  arena_allocator_t arena = {};
+  uint64_t bytes = 0x0123456789abcdefull;
+  void *empty = arena_allocator_alloc(&arena, 0);
+  uint64_t *next = arena_allocator_alloc(&arena, sizeof(bytes));
+  *next = bytes;
+  bool passed = empty != (void *)next;
+  uint64_t *grown =
+      arena_allocator_realloc(&arena, empty, 0, 4 * sizeof(bytes));
+  grown[0] = ~bytes;
+  passed = passed && *next == bytes;
+  arena_allocator_free(&arena, empty);
+  uint64_t *after = arena_allocator_alloc(&arena, sizeof(bytes));
+  *after = ~bytes;
+  passed = passed && after != next && *next == bytes;
+  arena_allocator_free(&arena, nullptr);
+
+  if (passed) {
+    ++t_run->passed;
+  } else {
+    ++t_run->failed;
+    fprintf(stderr, "[FAIL] arena: an empty allocation overlaps the next\n");
+  }
+  printf("[%s] arena_empty_alloc\n", passed ? "PASS" : "FAIL");
+}
+
+/// @internal
+INTERNAL_DEF bool test_write_case(const test_case *t_case,
+                                  const char *t_file) {
+  FILE *out = fopen(t_file, "wb");
+  if (!out) {
+    fprintf(stderr, "Error: could not open file `%s`: %s\n", t_file,
+            strerror(errno));
+    return false;
+  }
+  if (t_case->src) {
+    fputs(t_case->src, out);
+  } else {
+    t_case->write_src(out);
+  }
+  bool success = !ferror(out);
+  success = !fclose(out) && success;
+  if (!success) {
+    fprintf(stderr, "Error: could not write file `%s`: %s\n", t_file,
+            strerror(errno));
+  }
+  return success;
+}
+
+void help_msg(const char *utils_prg_name) {
+  printf("Usage: %s [--cc=compiler] [cases...]\n", utils_prg_name);
+  printf("Writes each test program into %s, compiles it at -O0 and -O1 and "
+         "checks the\nstatus it exits with on the bytecode VM, the JIT where "
+         "there is one, and the\nC and assembly backends\n",
+         TEST_DIR);
+  printf("args:\n");
+  printf("    cases   Which cases to run, all of them by default\n");
+  printf("    --cc    C compiler to build the generated code with, the C and "
+         "assembly\n"
+         "            backends are skipped without one\n");
+}
+
+int main(int argc, char **argv) {
+  char *prg = utils_shift_args(&argc, &argv);
+  test_run run = {.passed = 0, .failed = 0, .cc = nullptr};
+  bool selected[TEST_CASES_LEN] = {};
+  bool any_selected = false;
+  while (argc > 0) {
+    char *arg = utils_shift_args(&argc, &argv);
+    if (!strncmp(arg, "--cc=", strlen("--cc="))) {
+      run.cc = arg + strlen("--cc=");
+    } else if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+      help_msg(prg);
+      return 0;
+    } else {
+      size_t i = 0;
+      while (i < TEST_CASES_LEN && strcmp(arg, test_cases[i].name)) ++i;
+      if (i == TEST_CASES_LEN) {
+        help_msg(prg);
+        fprintf(stderr, "Error: unknown case %s\n", arg);
+        return 1;
+      }
+      selected[i] = true;
+      any_selected = true;
+    }
+  }
+
+  if (!any_selected) test_arena_empty_alloc(&run);
+
+  arena_allocator_t arena = {};
+  rda_allocator allocator = {arena_allocator_alloc, arena_allocator_free,
+                             arena_allocator_realloc, &arena};
+  for (size_t i = 0; i < TEST_CASES_LEN; ++i) {
+    if (any_selected && !selected[i]) continue;
+    const test_case *test = &test_cases[i];
+    char file[256];
+    snprintf(file, sizeof(file), TEST_DIR "%s.th", test->name);
+    if (!test_write_case(test, file)) return 1;
+    size_t failed = run.failed;
+    test_level(&run, test, file, opt_level_0, &allocator);
+    arena_allocator_reset(&arena);
+    test_level(&run, test, file, opt_level_1, &allocator);
+    arena_allocator_reset(&arena);
+    printf("[%s] %s\n", run.failed == failed ? "PASS" : "FAIL", test->name);
+  }
+  arena_allocator_free(&arena, nullptr);
+  printf("%zu checks passed, %zu failed\n", run.passed, run.failed);
+  return run.failed > 0;
+}